@@ -0,0 +1,58 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// ByteSource.h
+// Something decoders can take bytes from without caring whether they 
+// come straight from the server or out of a decompressor.
+
+#pragma once
+
+#include "rfb.h"
+
+class ByteSource
+{
+public:
+	// Returns the next n bytes, or NULL if there aren't that many to be
+	// had.  The pointer is only good until the next call.
+	virtual const CARD8 *Get(int n) = 0;
+};
+
+// Bytes which are already in memory
+class MemoryByteSource : public ByteSource
+{
+public:
+	MemoryByteSource(const CARD8 *data, int len) {
+		m_ptr = data;
+		m_end = data + len;
+	};
+	virtual const CARD8 *Get(int n) {
+		if (n > m_end - m_ptr) return 0;
+		const CARD8 *p = m_ptr;
+		m_ptr += n;
+		return p;
+	};
+
+private:
+	const CARD8 *m_ptr, *m_end;
+};
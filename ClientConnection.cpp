@@ -44,8 +44,11 @@ extern "C" {
 }
 
 #define INITIALNETBUFSIZE 4096
-#define MAX_ENCODINGS 10
+// Encodings and pseudo-encodings we may ask for
+#define MAX_ENCODINGS 20
 #define VWR_WND_CLASS_NAME _T("VNCviewer")
+#define IDT_POINTERTIMER 1
+#define IDT_STATSTIMER 2
 
 const rfbPixelFormat vnc8bitFormat = {8, 8, 1, 1, 7,7,3, 0,3,6,0,0};
 const rfbPixelFormat vnc16bitFormat = {16, 16, 1, 1, 63, 31, 31, 0,6,11,0,0};
@@ -134,11 +137,32 @@ void ClientConnection::Init(VNCviewerApp *pApp)
 	m_port = -1;
 	m_netbuf = NULL;
 	m_netbufsize = 0;
+	m_inbuf = new char[INPUTBUFSIZE];
+	m_inptr = m_inend = m_inbuf;
+	m_recvCalls = m_bytesRead = 0;
+	m_recorder = NULL;
+	m_readerThread = 0;
+	m_outbufLen = 0;
+	m_writeBatchDepth = 0;
+	m_messagesWritten = m_outputFlushes = m_sendCalls = m_bytesWritten = 0;
+	m_requestOutstanding = false;
+	m_requestTime = m_requestRTT = m_requestRTTTotal = m_requestRTTs = 0;
+	m_pointerX = m_pointerY = m_pointerMask = 0;
+	m_cursorX = m_cursorY = 0;
+	for (int i = 0; i < POINTERHISTORY; i++)
+		m_sentPointerX[i] = m_sentPointerY[i] = -1;
+	m_sentPointerNext = 0;
+	m_updatePointerMoved = m_serverPointerMoved = false;
+	m_updatePointerX = m_updatePointerY = m_serverPointerX = m_serverPointerY = 0;
+	m_pointerPending = m_pointerTimerSet = false;
+	m_lastPointerTime = 0;
+	m_pointerEventsIn = m_pointerEventsSent = 0;
 	m_hwndNextViewer = NULL;	
 	m_pApp = pApp;
 	m_dormant = false;
 	m_hBitmapDC = NULL;
 	m_hBitmap = NULL;
+	m_fbCapWidth = m_fbCapHeight = 0;
 	m_hPalette = NULL;
 
 	// We take the initial conn options from the application defaults
@@ -151,6 +175,48 @@ void ClientConnection::Init(VNCviewerApp *pApp)
 	m_pendingFormatChange = false;
 
 	m_hScrollPos = 0; m_vScrollPos = 0; m_barheight=0;
+	m_cliwidth = 0; m_cliheight = 0;
+	m_lastBackgroundRequest = 0;
+	m_viewportRequests = m_backgroundRequests = m_exposureRequests = 0;
+	m_exposurePending = false;
+	m_desktopResizing = false;
+	m_connectTime = 0;
+	m_updatesReceived = 0;
+	m_statsFile = INVALID_HANDLE_VALUE;
+	m_statsJSON = false;
+	m_lastStatsTime = m_lastStatsUpdates = 0;
+	m_cuState = CU_OFF;
+	m_supportsCU = m_supportsFence = m_cuThrottled = false;
+	m_fencesInFlight = 0;
+	// Until we know the round trip, allow plenty
+	m_fenceWindow = MAXFENCEWINDOW;
+	m_fenceRTT = m_minFenceRTT = m_updateInterval = m_lastCUUpdate = 0;
+	m_fencesSent = m_cuThrottles = 0;
+	m_syncFenceWait = 0;
+	m_dirtySince = 0;
+	m_rectsDamaged = m_rectsInvalidated = 0;
+	m_rleDecoder.Attach(&m_fb, &m_conv);
+	m_trleTile.Attach(m_trleTileBits, rfbTRLETileWidth, rfbTRLETileHeight,
+		rfbTRLETileWidth * sizeof(CARD32));
+	m_trleDecoder.Attach(&m_trleTile, &m_conv, true);
+	m_socketSource.Attach(this);
+	m_hextileBg = m_hextileFg = 0;
+	m_tightCutZeros = false;
+	memset(m_encRects, 0, sizeof(m_encRects));
+	memset(m_encBytes, 0, sizeof(m_encBytes));
+	memset(m_encTime, 0, sizeof(m_encTime));
+	memset(m_encPixels, 0, sizeof(m_encPixels));
+	m_autoEncoding = -1;
+	m_tuneSwitches = 0;
+	m_tuneUpdateBytes = m_tuneUpdateRecv = 0;
+	// Assume a fast link until we know better
+	m_tuneBandwidth = 1000;
+	m_tuneTime = GetTickCount();
+	m_autoDepth = 0;
+	m_depthUpdates = m_depthUpdateTime = m_depthChanges = 0;
+	m_depthChangeTime = GetTickCount();
+	m_recvTime = m_decodeTime = m_queueTime = m_paintTime = 0;
+	m_queueDrains = m_paints = 0;
 
 	m_fullScreenMode = false;
 
@@ -171,6 +237,10 @@ void ClientConnection::Init(VNCviewerApp *pApp)
 void ClientConnection::Run()
 {
 	int ecode;
+
+	// This thread does all the reading until the worker starts
+	m_readerThread = GetCurrentThreadId();
+
     __try {
 		// Get the host name and port if we haven't got it
 		if (m_port == -1) 
@@ -191,6 +261,9 @@ void ClientConnection::Run()
 		
 		SendClientInit();
 		
+		if (m_opts.m_recordToFile)
+			StartRecording();
+
 		ReadServerInit();
 		
 		CreateLocalFramebuffer();
@@ -199,6 +272,10 @@ void ClientConnection::Run()
 		
 		SetFormatAndEncodings();
 		
+		if (m_opts.m_statsToFile) {
+			OpenStatsFile();
+			SetTimer(m_hwnd, IDT_STATSTIMER, STATSINTERVAL, NULL);
+		}
 		
         // This starts the worker thread.
         // The rest of the processing continues in run_undetached.
@@ -633,13 +710,7 @@ void ClientConnection::ReadServerInit()
 	// Size the window.
 	// First we find out how large a window would be needed to hold the whole
 	// remote screen image.
-	RECT fullwinrect;
-	SetRect(&fullwinrect, 0, 0, m_si.framebufferWidth, m_si.framebufferHeight);
-	AdjustWindowRectEx(&fullwinrect, 
-		GetWindowLong(m_hwnd, GWL_STYLE), GetWindowLong(m_hwnd, GWL_EXSTYLE), FALSE);
-	UINT bandheight = CommandBands_Height(m_hbands);
-	m_fullwinwidth = fullwinrect.right - fullwinrect.left;
-	m_fullwinheight = fullwinrect.bottom - fullwinrect.top + bandheight ;
+	CalcFullWindowSize();
 
 	// Then we use either this, or the screen size, whichever is smaller
 	m_winwidth  = min(m_fullwinwidth,  workwidth);
@@ -654,19 +725,25 @@ void ClientConnection::ReadServerInit()
 	SetForegroundWindow(m_hwnd);
 }
 
+// How large a window would be needed to hold the whole remote screen
+
+void ClientConnection::CalcFullWindowSize()
+{
+	RECT fullwinrect;
+	SetRect(&fullwinrect, 0, 0, m_si.framebufferWidth, m_si.framebufferHeight);
+	AdjustWindowRectEx(&fullwinrect, 
+		GetWindowLong(m_hwnd, GWL_STYLE), GetWindowLong(m_hwnd, GWL_EXSTYLE), FALSE);
+	UINT bandheight = CommandBands_Height(m_hbands);
+	m_fullwinwidth = fullwinrect.right - fullwinrect.left;
+	m_fullwinheight = fullwinrect.bottom - fullwinrect.top + bandheight ;
+}
+
 // We keep a local copy of the whole screen.  This is not sctrictly necessary
 // for VNC, but makes scrolling & deiconifying much smoother.
 
 void ClientConnection::CreateLocalFramebuffer() {
-	// We create a bitmap which has the same pixel characteristics as
-	// the local display, in the hope that blitting will be faster.
-	TempDC hdc(m_hwnd);
-	m_hBitmap = ::CreateCompatibleBitmap(hdc, 
-									m_si.framebufferWidth, 
-									m_si.framebufferHeight);
-
-	if (m_hBitmap == NULL)
-		RaiseException(VNC_EXC_GRAPHICS,0,0,0);
+	SizeFramebuffer(m_si.framebufferWidth, m_si.framebufferHeight);
+
 	// Select this bitmap into the DC with an appropriate palette
 	ObjectSelector b(m_hBitmapDC, m_hBitmap);
 	PaletteSelector p(m_hBitmapDC, m_hPalette);
@@ -675,7 +752,7 @@ void ClientConnection::CreateLocalFramebuffer() {
     RECT rect;
 	SetRect(&rect, 0,0, m_si.framebufferWidth, m_si.framebufferHeight);
 	COLORREF bgcol = RGB(0xcc, 0xcc, 0xcc);
-	FillSolidRect(&rect, bgcol);
+	FillSolidRect(&rect, PIXEL_RGB(0xcc, 0xcc, 0xcc));
 	
 	COLORREF oldbgcol  = SetBkColor(  m_hBitmapDC, bgcol);
 	COLORREF oldtxtcol = SetTextColor(m_hBitmapDC, RGB(0,0,64));
@@ -686,19 +763,93 @@ void ClientConnection::CreateLocalFramebuffer() {
                     DT_SINGLELINE | DT_CENTER | DT_VCENTER);
 	SetBkColor(  m_hBitmapDC, oldbgcol);
 	SetTextColor(m_hBitmapDC, oldtxtcol);
+#ifndef UNDER_CE
+	// Make sure GDI has finished with the bits before we write to them.
+	GdiFlush();
+#endif
 
 	InvalidateRect(m_hwnd, NULL, FALSE);
 }
 
+// Make the framebuffer w x h, keeping what overlaps the old one.  We 
+// create a top-down 32-bit DIB section rather than a bitmap compatible 
+// with the display.  Blitting it may be a little slower, but the decoders
+// can then write pixels straight into its memory instead of calling 
+// SetPixel for every one.  Once there is a bitmap it is never shrunk, 
+// and is grown by at least FBGROWSTEP pixels at a time, so a desktop 
+// which keeps changing size doesn't mean a new bitmap every time.
+// After the initial screen, m_bitmapdcMutex must be held.
+
+void ClientConnection::SizeFramebuffer(int w, int h)
+{
+	int oldw = m_fb.IsValid() ? m_fb.m_width : 0;
+	int oldh = m_fb.IsValid() ? m_fb.m_height : 0;
+	CARD32 pad = PIXEL_RGB(0xcc, 0xcc, 0xcc);
+
+	if (m_hBitmap == NULL || w > m_fbCapWidth || h > m_fbCapHeight) {
+		int capw = w, caph = h;
+		if (m_hBitmap != NULL) {
+			capw = max(m_fbCapWidth, (w + FBGROWSTEP-1) / FBGROWSTEP * FBGROWSTEP);
+			caph = max(m_fbCapHeight, (h + FBGROWSTEP-1) / FBGROWSTEP * FBGROWSTEP);
+		}
+
+		BITMAPINFO bmi;
+		memset(&bmi, 0, sizeof(bmi));
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = capw;
+		bmi.bmiHeader.biHeight = -caph;
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+
+		void *bits = NULL;
+		TempDC hdc(m_hwnd);
+		HBITMAP hBitmap = ::CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+		if (hBitmap == NULL || bits == NULL)
+			RaiseException(VNC_EXC_GRAPHICS,0,0,0);
+
+		// The spare capacity past the desktop is blank too, since the
+		// window may be big enough to show some of it
+		PixelBuffer fb;
+		fb.Attach(bits, capw, caph, capw * sizeof(CARD32));
+		fb.FillRect(0, 0, capw, caph, pad);
+		if (m_hBitmap != NULL) {
+			int cw = min(oldw, w), ch = min(oldh, h);
+			for (int j = 0; j < ch; j++)
+				memcpy(fb.Row(j), m_fb.Row(j), cw * sizeof(CARD32));
+			DeleteObject(m_hBitmap);
+			log.Print(2, _T("Framebuffer bitmap is now %d x %d\n"), capw, caph);
+		}
+		m_hBitmap = hBitmap;
+		m_fbCapWidth = capw;
+		m_fbCapHeight = caph;
+		m_fb = fb;
+	} else {
+		// Clear what's no longer part of the desktop, in case the 
+		// window is big enough to show it
+		m_fb.FillRect(w, 0, oldw - w, oldh, pad);
+		m_fb.FillRect(0, h, oldw, oldh - h, pad);
+	}
+
+	m_fb.m_width = w;
+	m_fb.m_height = h;
+
+	// Anything new stays blank until the server sends it
+	m_fb.FillRect(oldw, 0, w - oldw, h, pad);
+	m_fb.FillRect(0, oldh, min(oldw, w), h - oldh, pad);
+}
+
 void ClientConnection::SetupPixelFormat() {
-	// Have we requested a reduction to 8-bit?
-    if (m_opts.m_Use8Bit) {		
+	// Have we requested a reduction to 8-bit, or is the link too slow
+	// for anything more?
+    if (m_opts.m_Use8Bit || m_autoDepth == 8) {		
       
 		log.Print(2, _T("Requesting 8-bit truecolour\n"));  
 		m_myFormat = vnc8bitFormat;
     
-		// We don't support colormaps so we'll ask the server to convert
-    } else if (!m_si.format.trueColour) {
+		// We don't support colormaps so we'll ask the server to convert,
+		// and we'll do the same if the link is too slow for bigger pixels.
+    } else if (!m_si.format.trueColour || m_autoDepth == 16) {
         
         // We'll just request a standard 16-bit truecolor
         log.Print(2, _T("Requesting 16-bit truecolour\n"));
@@ -752,6 +903,9 @@ void ClientConnection::SetFormatAndEncodings()
     
 	rfbSetPixelFormatMsg spf;
 
+	// Send the format and encodings together
+	BeginWriteBatch();
+
     spf.type = rfbSetPixelFormat;
     spf.format = m_myFormat;
     spf.format.redMax = Swap16IfLE(spf.format.redMax);
@@ -764,7 +918,25 @@ void ClientConnection::SetFormatAndEncodings()
     // The number of bytes required to hold at least one pixel.
 	m_minPixelBytes = (m_myFormat.bitsPerPixel + 7) >> 3;
 
-	// Set encodings
+	// Rebuild the pixel conversion tables for the new format
+	m_conv.SetFormat(m_myFormat);
+	m_tightCutZeros = (m_myFormat.bitsPerPixel == 32 && m_myFormat.depth == 24 &&
+		m_myFormat.redMax == 0xff && m_myFormat.greenMax == 0xff && 
+		m_myFormat.blueMax == 0xff);
+
+	// What the encodings cost depends on the pixel size, so start again
+	ResetAutoSelect();
+
+	SendEncodings();
+
+	EndWriteBatch();
+
+}
+
+// Ask for the encodings we can use, best first, and the pseudo-encodings.
+
+void ClientConnection::SendEncodings()
+{
     char buf[sz_rfbSetEncodingsMsg + MAX_ENCODINGS * 4];
     rfbSetEncodingsMsg *se = (rfbSetEncodingsMsg *)buf;
     CARD32 *encs = (CARD32 *)(&buf[sz_rfbSetEncodingsMsg]);
@@ -773,38 +945,206 @@ void ClientConnection::SetFormatAndEncodings()
     se->type = rfbSetEncodings;
     se->nEncodings = 0;
 
-	// Put the preferred encoding first, and change it if the
-	// preferred encoding is not actually usable.
+	// Change the preferred encoding if it is not actually usable.
 	for (int i = LASTENCODING; i >= rfbEncodingRaw; i--)
 	{
-		if (m_opts.m_PreferredEncoding == i) {
-			if (m_opts.m_UseEnc[i]) {
-				encs[se->nEncodings++] = Swap32IfLE(i);
-			} else {
-				m_opts.m_PreferredEncoding--;
-			}
-		}
+		if (m_opts.m_PreferredEncoding == i && !m_opts.m_UseEnc[i])
+			m_opts.m_PreferredEncoding--;
 	}
 
+	// Put the one chosen from measurements first if there is one, 
+	// otherwise the preferred one.
+	int first = m_opts.m_PreferredEncoding;
+	if (m_autoEncoding >= rfbEncodingRaw && m_opts.m_UseEnc[m_autoEncoding])
+		first = m_autoEncoding;
+	if (first >= rfbEncodingRaw)
+		encs[se->nEncodings++] = Swap32IfLE(first);
+
 	// Now we go through and put in all the other encodings in order.
 	// We do rather assume that the most recent encoding is the most
 	// desirable!
 	for (i = LASTENCODING; i >= rfbEncodingRaw; i--)
 	{
-		if ( (m_opts.m_PreferredEncoding != i) &&
+		if ( (first != i) &&
 			 (m_opts.m_UseEnc[i]))
 		{
 			encs[se->nEncodings++] = Swap32IfLE(i);
 		}
 	}
 
+	// Then the pseudo-encodings for compression and JPEG quality
+	if (m_opts.m_CompressLevel >= 0 && m_opts.m_CompressLevel <= 9)
+		encs[se->nEncodings++] = 
+			Swap32IfLE(rfbEncodingCompressLevel0 + m_opts.m_CompressLevel);
+	if (m_opts.m_QualityLevel >= 0 && m_opts.m_QualityLevel <= 9)
+		encs[se->nEncodings++] = 
+			Swap32IfLE(rfbEncodingQualityLevel0 + m_opts.m_QualityLevel);
+	if (m_opts.m_LocalCursor) {
+		encs[se->nEncodings++] = Swap32IfLE(rfbEncodingXCursor);
+		encs[se->nEncodings++] = Swap32IfLE(rfbEncodingRichCursor);
+		encs[se->nEncodings++] = Swap32IfLE(rfbEncodingPointerPos);
+	}
+	encs[se->nEncodings++] = Swap32IfLE(rfbEncodingExtDesktopSize);
+	encs[se->nEncodings++] = Swap32IfLE(rfbEncodingNewFBSize);
+	encs[se->nEncodings++] = Swap32IfLE(rfbEncodingLastRect);
+	if (m_opts.m_ContinuousUpdates) {
+		encs[se->nEncodings++] = Swap32IfLE(rfbEncodingContinuousUpdates);
+		encs[se->nEncodings++] = Swap32IfLE(rfbEncodingFence);
+	}
+
     len = sz_rfbSetEncodingsMsg + se->nEncodings * 4;
 	
     se->nEncodings = Swap16IfLE(se->nEncodings);
 	
     WriteExact((char *) buf, len);
+}
+
+// Until an encoding has been seen, guess what it costs.  Bytes are per 
+// thousand pixels and per byte of pixel, decoding time is in microseconds
+// per thousand pixels.
+
+static const struct {
+	int encoding;
+	DWORD bytesPerKP, usPerKP;
+} autoSelectPriors[] = {
+	{ rfbEncodingRaw,		1000,	10 },
+	{ rfbEncodingHextile,	400,	40 },
+	{ rfbEncodingTRLE,		250,	60 },
+	{ rfbEncodingZlib,		150,	80 },
+	{ rfbEncodingZRLE,		80,		150 },
+	{ rfbEncodingTight,		60,		250 },
+};
 
+#define NAUTOSELECTPRIORS (sizeof(autoSelectPriors) / sizeof(autoSelectPriors[0]))
 
+void ClientConnection::ResetAutoSelect()
+{
+	m_autoEncoding = -1;
+	memset(m_tuneBytesPerKP, 0, sizeof(m_tuneBytesPerKP));
+	memset(m_tuneUsPerKP, 0, sizeof(m_tuneUsPerKP));
+	for (int i = 0; i < NAUTOSELECTPRIORS; i++) {
+		int enc = autoSelectPriors[i].encoding;
+		m_tuneBytesPerKP[enc] = autoSelectPriors[i].bytesPerKP * m_conv.m_bytesPerPixel;
+		m_tuneUsPerKP[enc] = autoSelectPriors[i].usPerKP;
+	}
+	memcpy(m_tuneLastBytes, m_encBytes, sizeof(m_encBytes));
+	memcpy(m_tuneLastTime, m_encTime, sizeof(m_encTime));
+	memcpy(m_tuneLastPixels, m_encPixels, sizeof(m_encPixels));
+}
+
+// Every so often, measure the link from the updates read since the last
+// time, and see whether the encoding or the pixel depth should change.
+// Called after each update.
+
+void ClientConnection::AutoTune()
+{
+	if (GetTickCount() - m_tuneTime < AUTOSELECTINTERVAL) 
+		return;
+	m_tuneTime = GetTickCount();
+
+	// Time spent waiting during updates is near enough time spent 
+	// receiving them.  Bytes per ms are about KB per second.
+	if (m_tuneUpdateBytes >= AUTOSELECTMINBYTES) {
+		DWORD bw = min(m_tuneUpdateBytes / max(m_tuneUpdateRecv, 1), 100000);
+		m_tuneBandwidth = max((m_tuneBandwidth + bw) / 2, 1);
+		m_tuneUpdateBytes = m_tuneUpdateRecv = 0;
+	}
+
+	if (m_opts.m_AutoSelect)
+		AutoSelectEncoding();
+	if (m_opts.m_AutoDepth)
+		AutoSelectDepth();
+}
+
+// Work out from what has arrived since the last time how long a 
+// thousand pixels take to receive and decode in each encoding, and if 
+// another encoding would be much cheaper than the one we're asking for,
+// ask for that instead.
+
+void ClientConnection::AutoSelectEncoding()
+{
+	// Move the estimates halfway towards what was measured
+	for (int enc = rfbEncodingRaw; enc <= LASTENCODING; enc++) {
+		DWORD kp = (m_encPixels[enc] - m_tuneLastPixels[enc]) / 1000;
+		if (kp < AUTOSELECTMINPIXELS / 1000) continue;
+		DWORD bytes = (m_encBytes[enc] - m_tuneLastBytes[enc]) / kp;
+		DWORD us = (m_encTime[enc] - m_tuneLastTime[enc]) * 1000 / kp;
+		m_tuneBytesPerKP[enc] = (m_tuneBytesPerKP[enc] + bytes) / 2;
+		m_tuneUsPerKP[enc] = (m_tuneUsPerKP[enc] + us) / 2;
+		m_tuneLastBytes[enc] = m_encBytes[enc];
+		m_tuneLastTime[enc] = m_encTime[enc];
+		m_tuneLastPixels[enc] = m_encPixels[enc];
+	}
+
+	int current = m_autoEncoding >= rfbEncodingRaw ? 
+		m_autoEncoding : m_opts.m_PreferredEncoding;
+	int best = -1;
+	DWORD bestCost = 0, currentCost = 0;
+	for (int i = 0; i < NAUTOSELECTPRIORS; i++) {
+		int enc = autoSelectPriors[i].encoding;
+		if (!m_opts.m_UseEnc[enc]) continue;
+		DWORD cost = m_tuneBytesPerKP[enc] * 1000 / m_tuneBandwidth + 
+			m_tuneUsPerKP[enc];
+		if (enc == current)
+			currentCost = cost;
+		if (best < 0 || cost < bestCost) {
+			best = enc;
+			bestCost = cost;
+		}
+	}
+
+	// Don't switch back and forth between encodings that cost about the same
+	if (best < 0 || best == current || 
+		(currentCost != 0 && bestCost >= currentCost * 3 / 4))
+		return;
+
+	log.Print(1, _T("Switching from encoding %d (%lu us per 1000 pixels) to %d (%lu us): ")
+		_T("%lu bytes/ms, %lu bytes and %lu us decoding per 1000 pixels\n"),
+		current, currentCost, best, bestCost, m_tuneBandwidth,
+		m_tuneBytesPerKP[best], m_tuneUsPerKP[best]);
+	m_autoEncoding = best;
+	m_tuneSwitches++;
+	SendEncodings();
+}
+
+// If updates are slow to arrive because the link is slow, ask for 
+// smaller pixels, and when there's room to spare, bigger ones again.  
+// The change goes through the same path as one made in the options 
+// dialog.
+
+void ClientConnection::AutoSelectDepth()
+{
+	if (m_opts.m_Use8Bit || m_pendingFormatChange || m_depthUpdates == 0)
+		return;
+	DWORD latency = m_depthUpdateTime / m_depthUpdates;
+	m_depthUpdates = m_depthUpdateTime = 0;
+	if (GetTickCount() - m_depthChangeTime < AUTODEPTHHOLD)
+		return;
+
+	int bpp = m_myFormat.bitsPerPixel;
+	int depth = m_autoDepth;
+	if (latency > AUTODEPTHSLOW && m_tuneBandwidth < AUTODEPTHSLOWBANDWIDTH) {
+		if (bpp > 16)
+			depth = 16;
+		else if (bpp > 8)
+			depth = 8;
+	} else if (m_autoDepth != 0 && 
+		(m_tuneBandwidth > AUTODEPTHFASTBANDWIDTH ||
+		 (latency * 2 < AUTODEPTHFAST && m_tuneBandwidth >= AUTODEPTHSLOWBANDWIDTH))) {
+		if (m_autoDepth == 8 && m_si.format.bitsPerPixel > 16)
+			depth = 16;
+		else
+			depth = 0;
+	}
+	if (depth == m_autoDepth)
+		return;
+
+	log.Print(1, _T("Switching from %d-bit to %d-bit pixels: updates taking %lu ms at %lu bytes/ms\n"),
+		bpp, depth != 0 ? depth : m_si.format.bitsPerPixel, latency, m_tuneBandwidth);
+	m_autoDepth = depth;
+	m_depthChangeTime = GetTickCount();
+	m_depthChanges++;
+	m_pendingFormatChange = true;
 }
 
 // Closing down the connection.
@@ -833,9 +1173,15 @@ ClientConnection::~ClientConnection()
 		m_sock = INVALID_SOCKET;
 	}
 
+	CloseStatsFile();
+	delete m_recorder;
+
 	if (m_desktopName != NULL) delete [] m_desktopName;
 	delete [] m_netbuf;
+	delete [] m_inbuf;
 	DeleteDC(m_hBitmapDC);
+	// The framebuffer memory goes with the DIB section
+	m_fb.Detach();
 	if (m_hBitmap != NULL)
 		DeleteObject(m_hBitmap);
 	if (m_hBitmapDC != NULL)
@@ -850,6 +1196,8 @@ ClientConnection::~ClientConnection()
 // tell you whether it actually scrolled.
 bool ClientConnection::ScrollScreen(int dx, int dy) 
 {
+	RECT oldvp;
+	GetViewport(&oldvp);
 	dx = max(dx, -m_hScrollPos);
 	//dx = min(dx, m_hScrollMax-(m_cliwidth-1)-m_hScrollPos);
 	dx = min(dx, m_hScrollMax-(m_cliwidth)-m_hScrollPos);
@@ -863,6 +1211,7 @@ bool ClientConnection::ScrollScreen(int dx, int dy)
 		GetClientRect(m_hwnd, &clirect);
 		ScrollWindowEx(m_hwnd, -dx, -dy, NULL, &clirect, NULL, NULL,  SW_INVALIDATE);
 		UpdateScrollbars();
+		RequestNewlyVisible(&oldvp);
 		UpdateWindow(m_hwnd);
 		return true;
 	}
@@ -887,6 +1236,14 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 		_this->DoBlit();
 		return 0;
 
+	case WM_REGIONUPDATED:
+		_this->ProcessDirtyRects();
+		return 0;
+
+	case WM_DESKTOPRESIZED:
+		_this->DesktopResized();
+		return 0;
+
 	case WM_LBUTTONDOWN:
 	case WM_LBUTTONUP:
         // Alt-click = right click
@@ -914,6 +1271,17 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 			return 0;
 		}
 
+	case WM_TIMER:
+		if (wParam == IDT_POINTERTIMER) {
+			_this->FlushPointerEvent();
+			return 0;
+		}
+		if (wParam == IDT_STATSTIMER) {
+			_this->WriteStats();
+			return 0;
+		}
+		break;
+
 	case WM_KEYDOWN:
 	case WM_KEYUP:
 	case WM_SYSKEYDOWN:
@@ -940,8 +1308,10 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 
             if (key < 32) key += 64;  // map ctrl-keys onto alphabet
             if (key > 32 && key < 127) {
+                _this->BeginWriteBatch();
                 _this->SendKeyEvent(wParam & 0xff, true);
                 _this->SendKeyEvent(wParam & 0xff, false);
+                _this->EndWriteBatch();
             }
             return 0;
         }
@@ -973,12 +1343,14 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 				SetWindowPos(hwnd, hwndafter, 0,0,100,100, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
 			}
 			log.Print(6, _T("Losing focus - cancelling modifiers\n"));
+			_this->BeginWriteBatch();
 			_this->SendKeyEvent(XK_Alt_L,     false);
 			_this->SendKeyEvent(XK_Control_L, false);
 			_this->SendKeyEvent(XK_Shift_L,   false);
 			_this->SendKeyEvent(XK_Alt_R,     false);
 			_this->SendKeyEvent(XK_Control_R, false);
 			_this->SendKeyEvent(XK_Shift_R,   false);
+			_this->EndWriteBatch();
 			return 0;
 		}
 	case WM_CLOSE:
@@ -1039,6 +1411,8 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
             // Update these for the record
 			// And consider that in full-screen mode the window
 			// is actually bigger than the remote screen.
+			RECT oldvp;
+			_this->GetViewport(&oldvp);
 			GetClientRect(hwnd, &rect);
 			_this->m_barheight = CommandBands_Height (_this->m_hbands);
 			_this->m_cliwidth = min( rect.right - rect.left, 
@@ -1061,6 +1435,7 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 			_this->m_hScrollPos = newhpos;
 			_this->m_vScrollPos = newvpos;
            	_this->UpdateScrollbars();
+			_this->RequestNewlyVisible(&oldvp);
 
 			return 0;
 		}
@@ -1162,12 +1537,14 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 				return 0;
 
 			case ID_CONN_CTLALTDEL:
+				_this->BeginWriteBatch();
 				_this->SendKeyEvent(XK_Control_L, true);
 				_this->SendKeyEvent(XK_Alt_L,     true);
 				_this->SendKeyEvent(XK_Delete,    true);
 				_this->SendKeyEvent(XK_Delete,    false);
 				_this->SendKeyEvent(XK_Alt_L,     false);
 				_this->SendKeyEvent(XK_Control_L, false);
+				_this->EndWriteBatch();
 				return 0;
             case ID_CONN_CTLDOWN:
                 _this->SendKeyEvent(XK_Control_L, true);
@@ -1253,9 +1630,15 @@ LRESULT CALLBACK ClientConnection::WndProc(HWND hwnd, UINT iMsg,
 	
 	case WM_SETCURSOR:
 		{
-			// if we have the focus, let the cursor change as normal
-			if (GetFocus() == hwnd) 
+			// if we have the focus, let the cursor change as normal,
+			// unless we're drawing the server's cursor ourselves
+			if (GetFocus() == hwnd) {
+				if (_this->m_cursor.IsVisible() && LOWORD(lParam) == HTCLIENT) {
+					SetCursor(NULL);
+					return TRUE;
+				}
 				break;
+			}
 
 			// if not, set to default system cursor
 			SetCursor( LoadCursor(NULL, IDC_ARROW));
@@ -1319,8 +1702,49 @@ ClientConnection::ProcessPointerEvent(int x, int y, DWORD keyflags)
 			((keyflags & MK_RBUTTON) ? rfbButton3Mask : 0)  );
 	}
 	
+	m_pointerEventsIn++;
+	m_pointerX = x + m_hScrollPos;
+	m_pointerY = y + m_vScrollPos;
+	MoveLocalCursor(m_pointerX, m_pointerY);
+
+	// Movement with the same buttons can wait until the interval is up,
+	// and then only the latest position is sent.
+	DWORD now = GetTickCount();
+	DWORD elapsed = now - m_lastPointerTime;
+	if (mask == m_pointerMask && m_opts.m_PointerInterval > 0 &&
+		elapsed < (DWORD) m_opts.m_PointerInterval) {
+		m_pointerPending = true;
+		if (!m_pointerTimerSet) {
+			SetTimer(m_hwnd, IDT_POINTERTIMER, 
+				m_opts.m_PointerInterval - elapsed, NULL);
+			m_pointerTimerSet = true;
+		}
+		return;
+	}
+
+	// Button changes go immediately.  Any movement being held carries 
+	// the old buttons at an older position, so this replaces it.
+	m_pointerMask = mask;
+	m_pointerPending = true;
+	FlushPointerEvent();
+}
+
+// Sends the pointer position being held back, if there is one.
+// Called by the pointer timer, and when a pointer event can go at once.
+
+void
+ClientConnection::FlushPointerEvent()
+{
+	if (m_pointerTimerSet) {
+		KillTimer(m_hwnd, IDT_POINTERTIMER);
+		m_pointerTimerSet = false;
+	}
+	if (!m_pointerPending) return;
+	m_pointerPending = false;
+	m_lastPointerTime = GetTickCount();
+
 	__try {
-		SendPointerEvent(x + m_hScrollPos, y + m_vScrollPos, mask);
+		SendPointerEvent(m_pointerX, m_pointerY, m_pointerMask);
 	}  __except (EXCEPTION_EXECUTE_HANDLER) {
 	        PostMessage(m_hwnd, WM_CLOSE, 0, 0);
 	}
@@ -1342,6 +1766,11 @@ ClientConnection::SendPointerEvent(int x, int y, int buttonMask)
     pe.x = Swap16IfLE(x);
     pe.y = Swap16IfLE(y);
 	WriteExact((char *)&pe, sz_rfbPointerEventMsg);
+	m_pointerEventsSent++;
+
+	m_sentPointerX[m_sentPointerNext] = x;
+	m_sentPointerY[m_sentPointerNext] = y;
+	m_sentPointerNext = (m_sentPointerNext + 1) % POINTERHISTORY;
 }
 
 //
@@ -1401,6 +1830,9 @@ inline void ClientConnection::ProcessKeyEvent(int virtkey, DWORD keyData)
     __try {
     KeyActionSpec kas = m_keymap.PCtoX(virtkey, keyData);    
 
+    // Send everything this key produces in one go
+    BeginWriteBatch();
+
     if (kas.releaseModifiers & KEYMAP_LCONTROL) {
         SendKeyEvent(XK_Control_L, false );
         log.Print(5, _T("fake L Ctrl raised\n"));
@@ -1440,6 +1872,8 @@ inline void ClientConnection::ProcessKeyEvent(int virtkey, DWORD keyData)
         SendKeyEvent(XK_Control_L, false );
         log.Print(5, _T("fake L Ctrl pressed\n"));
     }
+
+    EndWriteBatch();
     } __except (EXCEPTION_EXECUTE_HANDLER) {
         PostMessage(m_hwnd, WM_CLOSE, 0, 0);
     }
@@ -1473,8 +1907,10 @@ void ClientConnection::SendClientCutText(char *str, int len)
 
     cct.type = rfbClientCutText;
     cct.length = Swap32IfLE(len);
+	BeginWriteBatch();
     WriteExact((char *)&cct, sz_rfbClientCutTextMsg);
 	WriteExact(str, len);
+	EndWriteBatch();
 	log.Print(6, _T("Sent %d bytes of clipboard\n"), len);
 }
 #endif
@@ -1485,6 +1921,7 @@ inline void ClientConnection::DoBlit()
 {
 	if (m_hBitmap == NULL) return;
 	if (!m_running) return;
+	DWORD start = GetTickCount();
 	omni_mutex_lock l(m_bitmapdcMutex);
 				
 	PAINTSTRUCT ps;
@@ -1503,10 +1940,22 @@ inline void ClientConnection::DoBlit()
 		::Sleep(m_pApp->m_options.m_delay);
 	}
 	
-	if (!BitBlt(hdc, ps.rcPaint.left, ps.rcPaint.top, 
+	// The cursor is drawn into the bitmap only while it's copied to the
+	// screen, so the framebuffer stays as the server sent it.
+	m_cursor.Draw(&m_fb, m_cursorX, m_cursorY);
+
+	BOOL blitted = BitBlt(hdc, ps.rcPaint.left, ps.rcPaint.top, 
 		ps.rcPaint.right-ps.rcPaint.left, ps.rcPaint.bottom-ps.rcPaint.top, 
 		m_hBitmapDC, ps.rcPaint.left+m_hScrollPos, ps.rcPaint.top+m_vScrollPos-m_barheight,
-		SRCCOPY)) 
+		SRCCOPY);
+
+#ifndef UNDER_CE
+	// The blit may still be in progress, and it reads the bitmap
+	GdiFlush();
+#endif
+	m_cursor.Undraw(&m_fb);
+
+	if (!blitted) 
 	{
 		log.Print(0, _T("Blit error %d\n"), GetLastError());
 		RaiseException(VNC_EXC_GRAPHICS,0,0,0);
@@ -1514,6 +1963,8 @@ inline void ClientConnection::DoBlit()
 	
 
 	EndPaint(m_hwnd, &ps);
+	m_paintTime += GetTickCount() - start;
+	m_paints++;
 }
 
 inline void ClientConnection::UpdateScrollbars() 
@@ -1554,19 +2005,25 @@ void ClientConnection::ShowConnInfo()
 #else
 	TCHAR *kbdname = _T("(n/a)");
 #endif
-	_stprintf(
-		buf,
+	// The desktop name comes from the server, so it may be any length
+	_sntprintf(
+		buf, 2047,
 		_T("Connected to: %s:\n\r")
 		_T("Host: %s port: %d\n\r\n\r")
 		_T("Desktop geometry: %d x %d x %d\n\r")
 		_T("Using depth: %d\n\r")
 		_T("Current protocol version: %d.%d\n\r\n\r")
-		_T("Current keyboard name: %s\n\r"),
+		_T("Current keyboard name: %s\n\r\n\r")
+		_T("Pointer events: %lu received, %lu sent\n\r\n\r"),
 		m_desktopName, m_host, m_port,
 		m_si.framebufferWidth, m_si.framebufferHeight, m_si.format.depth,
 		m_myFormat.depth,
 		m_majorVersion, m_minorVersion,
-		kbdname);
+		kbdname,
+		m_pointerEventsIn, m_pointerEventsSent);
+	buf[2047] = _T('\0');
+	int len = _tcslen(buf);
+	FormatStats(buf + len, 2048 - len);
 	MessageBox(NULL, buf, _T("VNC connection info"), MB_ICONINFORMATION | MB_OK);
 }
 
@@ -1582,6 +2039,11 @@ void* ClientConnection::run_undetached(void* arg) {
 
 	m_threadStarted = true;
 
+	// From now on this thread is the only one which reads from the server.
+	// The main thread finished reading before it started us.
+	m_readerThread = GetCurrentThreadId();
+	m_connectTime = GetTickCount();
+
 	__try {
 
 
@@ -1593,44 +2055,46 @@ void* ClientConnection::run_undetached(void* arg) {
 		
 		while (!m_bKillThread) {
 			
-			// Look at the type of the message, but leave it in the buffer 
+			// Read the type of the message.  On CE we can't peek, so we
+			// read the byte now, and one less later.  It normally comes
+			// out of the input buffer without a system call.
 			CARD8 msgType;
-			int bytes;
-			{
-			  omni_mutex_lock l(m_readMutex);
-			  // on CE, we can't peek, so we read the bytes now, and one 
-			  // less later
-			  bytes = recv(m_sock, (char *) &msgType, 1, 0);
-			}
-			if (bytes == 0) {
-				log.Print(0, _T("Socket closed\n") );
-				RaiseException(VNC_EXC_SOCKET,0,0,0);
-			}
-			if (bytes < 0) {
-				log.Print(3, _T("Socket error reading message: %d\n"), WSAGetLastError() );
-				RaiseException(VNC_EXC_SOCKET,0,0,0);
-			}
+			ReadExact((char *) &msgType, 1);
 				
 			switch (msgType) {
 			case rfbFramebufferUpdate:
+				{
+				m_updatesReceived++;
+				UpdateRequestAnswered();
+				// Continuous updates come without being asked for
+				if (m_cuState != CU_OFF) {
+					ReadScreenUpdate();
+					ContinuousUpdateReceived();
+					break;
+				}
+
+				// When pipelining, ask for the next update now so that the
+				// server can be working on it while we decode this one.
+				// There is then at most one request outstanding, and its
+				// reply follows this update.
+				bool requested = false;
+				if (m_opts.m_PipelineUpdates && !m_pendingFormatChange && !m_dormant) {
+					SendIncrementalFramebufferUpdateRequest();
+					requested = true;
+				}
 				ReadScreenUpdate();
 				if (m_pendingFormatChange) {
-					log.Print(3, _T("Requesting new pixel format\n") );
-					rfbPixelFormat oldFormat = m_myFormat;
-					SetupPixelFormat();
-					SetFormatAndEncodings();
-					m_pendingFormatChange = false;
-					// If the pixel format has changed, request whole screen
-					if (memcmp(&m_myFormat, &oldFormat, sizeof(rfbPixelFormat)) != 0) {
-						SendFullFramebufferUpdateRequest();
-					} else {
-						SendIncrementalFramebufferUpdateRequest();
-					}
+					// The reply to a request we've already sent will be in
+					// the old format, so wait until it has been read.
+					if (requested) break;
+					ChangePixelFormat();
 				} else {
-					if (!m_dormant)
+					if (!requested && !m_dormant)
 						SendIncrementalFramebufferUpdateRequest();
+					CheckContinuousUpdates();
 				}
 				break;
+				}
 			case rfbSetColourMapEntries:
 			        log.Print(3, _T("rfbSetColourMapEntries read but not supported\n") );
 				RaiseException(VNC_EXC_UNIMPLEMENTED,0,0,0);
@@ -1641,15 +2105,58 @@ void* ClientConnection::run_undetached(void* arg) {
 			case rfbServerCutText:
 				ReadServerCutText();
 				break;
+			case rfbEndOfContinuousUpdates:
+				ReadEndOfContinuousUpdates();
+				break;
+			case rfbServerFence:
+				ReadFence();
+				break;
 			default:
                 log.Print(3, _T("Unknown message type x%02x\n"), msgType );
 
 				RaiseException(VNC_EXC_UNIMPLEMENTED,0,0,0);
 			}
 
+			if (m_syncFenceWait > 0 && --m_syncFenceWait == 0)
+				SendSyncFenceReply();
 		}
         
         log.Print(4, _T("Update-processing thread finishing\n") );
+		log.Print(2, _T("Read %lu bytes in %lu recv calls\n"), m_bytesRead, m_recvCalls);
+		DWORD secs = (GetTickCount() - m_connectTime) / 1000;
+		log.Print(2, _T("Received %lu bytes/sec over %lu seconds\n"), 
+			m_bytesRead / max(secs, 1), secs);
+		log.Print(2, _T("Received %lu updates, %lu per minute\n"), 
+			m_updatesReceived, m_updatesReceived * 60 / max(secs, 1));
+		log.Print(2, _T("Sent %lu fences, round trip %lu ms (shortest %lu), window %d, fell behind %lu times\n"),
+			m_fencesSent, m_fenceRTT, m_minFenceRTT, m_fenceWindow, m_cuThrottles);
+		log.Print(2, _T("Sent %lu viewport, %lu background and %lu exposure update requests\n"),
+			m_viewportRequests, m_backgroundRequests, m_exposureRequests);
+		log.Print(2, _T("Spent %lu ms waiting for data and %lu ms decoding\n"),
+			m_recvTime, m_decodeTime);
+		log.Print(2, _T("Updated areas waited %lu ms on average to be invalidated\n"),
+			m_queueTime / max(m_queueDrains, 1));
+		log.Print(2, _T("Spent %lu ms in %lu paints\n"), m_paintTime, m_paints);
+		log.Print(2, _T("Merged %lu updated rectangles into %lu invalidations\n"),
+			m_rectsDamaged, m_rectsInvalidated);
+		log.Print(2, _T("ZRLE inflated %lu bytes to %lu\n"), 
+			m_zrleStream.m_bytesIn, m_zrleStream.m_bytesOut);
+		log.Print(2, _T("Zlib inflated %lu bytes to %lu\n"), 
+			m_zlibStream.m_bytesIn, m_zlibStream.m_bytesOut);
+		log.Print(2, _T("ZlibHex inflated %lu bytes to %lu\n"), 
+			m_zlibHexRawStream.m_bytesIn + m_zlibHexEncStream.m_bytesIn, 
+			m_zlibHexRawStream.m_bytesOut + m_zlibHexEncStream.m_bytesOut);
+		for (int enc = rfbEncodingRaw; enc <= LASTENCODING; enc++) {
+			if (m_encRects[enc] == 0) continue;
+			// Bytes per millisecond are near enough KB per second
+			log.Print(2, _T("Encoding %d: %lu rectangles, %lu bytes, %lu ms decoding, %lu KB/s\n"),
+				enc, m_encRects[enc], m_encBytes[enc], m_encTime[enc],
+				m_encBytes[enc] / max(m_encTime[enc], 1));
+		}
+		log.Print(2, _T("Switched encodings %lu times and pixel depth %lu times, measured %lu bytes/ms\n"),
+			m_tuneSwitches, m_depthChanges, m_tuneBandwidth);
+		log.Print(2, _T("Wrote %lu messages in %lu flushes and %lu send calls\n"), 
+			m_messagesWritten, m_outputFlushes, m_sendCalls);
 
 	} __except(EXCEPTION_EXECUTE_HANDLER) {
 		PostMessage(m_hwnd, WM_CLOSE, 0, 0);
@@ -1675,21 +2182,330 @@ ClientConnection::SendFramebufferUpdateRequest(int x, int y, int w, int h, bool
     fur.h = Swap16IfLE(h);
 
 	log.Print(10, _T("Request %s update\n"), incremental ? _T("incremental") : _T("full"));
+	{
+		omni_mutex_lock l(m_writeMutex);
+		if (!m_requestOutstanding) {
+			m_requestOutstanding = true;
+			m_requestTime = GetTickCount();
+		}
+	}
     WriteExact((char *)&fur, sz_rfbFramebufferUpdateRequestMsg);
 }
 
+// Normally we only ask for changes to the part of the desktop which is
+// in the window.  Every m_BackgroundInterval ms we ask for the whole 
+// desktop instead, so that the rest of it is fairly up to date when it
+// is scrolled into view.  Anything which has come into view since the
+// last request is asked for in full first.
 inline void ClientConnection::SendIncrementalFramebufferUpdateRequest()
 {
-    SendFramebufferUpdateRequest(0, 0, m_si.framebufferWidth,
+	RECT vp, fb, ex;
+	bool exposed;
+	{
+		omni_mutex_lock l(m_writeMutex);
+		exposed = m_exposurePending;
+		ex = m_exposedRect;
+		m_exposurePending = false;
+	}
+	SetRect(&fb, 0, 0, m_si.framebufferWidth, m_si.framebufferHeight);
+	if (exposed && IntersectRect(&ex, &ex, &fb)) {
+		m_exposureRequests++;
+		SendFramebufferUpdateRequest(ex.left, ex.top,
+			ex.right - ex.left, ex.bottom - ex.top, false);
+		return;
+	}
+
+	GetViewport(&vp);
+	DWORD now = GetTickCount();
+
+	if (!m_opts.m_ViewportUpdates ||
+		(vp.left == 0 && vp.top == 0 &&
+		 vp.right == m_si.framebufferWidth && vp.bottom == m_si.framebufferHeight) ||
+		now - m_lastBackgroundRequest >= (DWORD) m_opts.m_BackgroundInterval) {
+		m_lastBackgroundRequest = now;
+		m_backgroundRequests++;
+		SendFramebufferUpdateRequest(0, 0, m_si.framebufferWidth,
 					m_si.framebufferHeight, true);
+		return;
+	}
+
+	m_viewportRequests++;
+	SendFramebufferUpdateRequest(vp.left, vp.top, 
+		vp.right - vp.left, vp.bottom - vp.top, true);
 }
 
 inline void ClientConnection::SendFullFramebufferUpdateRequest()
 {
+	{
+		omni_mutex_lock l(m_writeMutex);
+		m_exposurePending = false;
+	}
+	m_lastBackgroundRequest = GetTickCount();
     SendFramebufferUpdateRequest(0, 0, m_si.framebufferWidth,
 					m_si.framebufferHeight, false);
 }
 
+// Called by the worker thread to change pixel format when there are no 
+// updates on their way in the old one.
+
+void ClientConnection::ChangePixelFormat()
+{
+	log.Print(3, _T("Requesting new pixel format\n") );
+	rfbPixelFormat oldFormat = m_myFormat;
+	SetupPixelFormat();
+	SetFormatAndEncodings();
+	m_pendingFormatChange = false;
+	// If the pixel format has changed, request whole screen
+	if (memcmp(&m_myFormat, &oldFormat, sizeof(rfbPixelFormat)) != 0) {
+		SendFullFramebufferUpdateRequest();
+	} else {
+		SendIncrementalFramebufferUpdateRequest();
+	}
+}
+
+// Ask for continuous updates of the area we'd otherwise request, or ask
+// for them to stop.
+
+void ClientConnection::SendEnableContinuousUpdates(bool enable)
+{
+	RECT vp;
+	if (m_opts.m_ViewportUpdates)
+		GetViewport(&vp);
+	else
+		SetRect(&vp, 0, 0, m_si.framebufferWidth, m_si.framebufferHeight);
+
+	rfbEnableContinuousUpdatesMsg ecu;
+	ecu.type = rfbEnableContinuousUpdates;
+	ecu.enable = enable ? 1 : 0;
+	ecu.x = Swap16IfLE(vp.left);
+	ecu.y = Swap16IfLE(vp.top);
+	ecu.w = Swap16IfLE(vp.right - vp.left);
+	ecu.h = Swap16IfLE(vp.bottom - vp.top);
+	WriteExact((char *) &ecu, sz_rfbEnableContinuousUpdatesMsg);
+}
+
+// Called by the worker thread to start continuous updates if we can.
+
+void ClientConnection::CheckContinuousUpdates()
+{
+	if (!m_opts.m_ContinuousUpdates || !m_supportsCU || !m_supportsFence) return;
+	if (m_cuState != CU_OFF || m_cuThrottled || m_dormant || m_pendingFormatChange) return;
+
+	log.Print(4, _T("Starting continuous updates\n"));
+	SendEnableContinuousUpdates(true);
+	m_cuState = CU_ON;
+	m_lastCUUpdate = 0;
+}
+
+void ClientConnection::StopContinuousUpdates()
+{
+	if (m_cuState != CU_ON) return;
+	log.Print(4, _T("Stopping continuous updates\n"));
+	SendEnableContinuousUpdates(false);
+	m_cuState = CU_STOPPING;
+}
+
+// Called by the worker thread after reading a continuous update.
+
+void ClientConnection::ContinuousUpdateReceived()
+{
+	DWORD now = GetTickCount();
+	if (m_lastCUUpdate != 0) {
+		DWORD interval = now - m_lastCUUpdate;
+		m_updateInterval = (m_updateInterval == 0) ? interval :
+			(3 * m_updateInterval + interval) / 4;
+	}
+	m_lastCUUpdate = now;
+
+	if (m_cuState != CU_ON) return;
+
+	// The rest of the desktop still needs asking for now and then
+	if (m_opts.m_ViewportUpdates &&
+		now - m_lastBackgroundRequest >= (DWORD) m_opts.m_BackgroundInterval) {
+		m_lastBackgroundRequest = now;
+		m_backgroundRequests++;
+		SendFramebufferUpdateRequest(0, 0, m_si.framebufferWidth,
+			m_si.framebufferHeight, true);
+	}
+
+	// The fence's payload is just when we sent it
+	SendFence(rfbFenceFlagRequest | rfbFenceFlagBlockBefore, sizeof(now), (char *) &now);
+	m_fencesSent++;
+	m_fencesInFlight++;
+
+	if (m_fencesInFlight >= m_fenceWindow) {
+		log.Print(5, _T("%d fences outstanding - falling back to update requests\n"),
+			m_fencesInFlight);
+		m_cuThrottled = true;
+		m_cuThrottles++;
+		StopContinuousUpdates();
+	} else if (m_pendingFormatChange || m_dormant) {
+		StopContinuousUpdates();
+	}
+}
+
+// The server has stopped continuous updates, or is telling us it can do
+// them.  We go back to asking for updates, changing format first if 
+// that's what we stopped them for.
+
+void ClientConnection::ReadEndOfContinuousUpdates()
+{
+	bool wasOn = (m_cuState != CU_OFF);
+	m_supportsCU = true;
+	m_cuState = CU_OFF;
+
+	if (!wasOn) {
+		CheckContinuousUpdates();
+		return;
+	}
+
+	log.Print(4, _T("Continuous updates ended\n"));
+	if (m_pendingFormatChange)
+		ChangePixelFormat();
+	else if (!m_dormant)
+		SendIncrementalFramebufferUpdateRequest();
+}
+
+void ClientConnection::SendSyncFenceReply()
+{
+	m_syncFenceWait = 0;
+	SendFence(m_syncFenceFlags, m_syncFenceLength, m_syncFencePayload);
+}
+
+void ClientConnection::SendFence(CARD32 flags, int len, const char *payload)
+{
+	char buf[sz_rfbFenceMsg + rfbFenceMaxPayload];
+	rfbFenceMsg *fm = (rfbFenceMsg *) buf;
+	fm->type = rfbClientFence;
+	fm->pad1 = 0;
+	fm->pad2 = 0;
+	fm->flags = Swap32IfLE(flags);
+	fm->length = len;
+	memcpy(buf + sz_rfbFenceMsg, payload, len);
+	WriteExact(buf, sz_rfbFenceMsg + len);
+}
+
+// We deal with everything from the server in order, so fences asking for
+// that are answered straight away, or once the next message has been 
+// dealt with if they have SyncNext set.  Replies to our own fences tell us 
+// how far behind the server we are.
+
+void ClientConnection::ReadFence()
+{
+	rfbFenceMsg fm;
+	ReadExact(((char *) &fm)+1, sz_rfbFenceMsg-1);
+	CARD32 flags = Swap32IfLE(fm.flags);
+	if (fm.length > rfbFenceMaxPayload) {
+		log.Print(0, _T("Fence payload too long: %d\n"), fm.length);
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+	char payload[rfbFenceMaxPayload];
+	ReadExact(payload, fm.length);
+
+	if (flags & rfbFenceFlagRequest) {
+		flags &= rfbFenceFlagBlockBefore | rfbFenceFlagBlockAfter | rfbFenceFlagSyncNext;
+		// If this is the message an earlier SyncNext fence was waiting 
+		// for, that one's reply goes first.
+		if (m_syncFenceWait > 0)
+			SendSyncFenceReply();
+		if (flags & rfbFenceFlagSyncNext) {
+			m_syncFenceFlags = flags;
+			m_syncFenceLength = fm.length;
+			memcpy(m_syncFencePayload, payload, fm.length);
+			m_syncFenceWait = 2;
+		} else {
+			SendFence(flags, fm.length, payload);
+		}
+		if (!m_supportsFence) {
+			m_supportsFence = true;
+			CheckContinuousUpdates();
+		}
+		return;
+	}
+
+	DWORD sent;
+	if (fm.length != sizeof(sent) || m_fencesInFlight == 0) return;
+	memcpy(&sent, payload, sizeof(sent));
+	DWORD rtt = GetTickCount() - sent;
+	m_fencesInFlight--;
+
+	m_fenceRTT = (m_fenceRTT == 0) ? rtt : (3 * m_fenceRTT + rtt) / 4;
+	if (m_minFenceRTT == 0 || rtt < m_minFenceRTT)
+		m_minFenceRTT = rtt;
+
+	// Enough updates to fill the shortest round trip, and a bit over
+	m_fenceWindow = m_minFenceRTT / max(m_updateInterval, 1) + MINFENCEWINDOW;
+	m_fenceWindow = min(m_fenceWindow, MAXFENCEWINDOW);
+
+	if (m_cuThrottled && m_fencesInFlight <= m_fenceWindow / 2) {
+		m_cuThrottled = false;
+		CheckContinuousUpdates();
+	}
+}
+
+// The part of the remote desktop which is visible in the window.
+// Until the window has been sized this is the whole desktop.
+void ClientConnection::GetViewport(RECT *pRect)
+{
+	if (m_cliwidth <= 0 || m_cliheight <= 0) {
+		SetRect(pRect, 0, 0, m_si.framebufferWidth, m_si.framebufferHeight);
+		return;
+	}
+	pRect->left   = max(m_hScrollPos, 0);
+	pRect->top    = max(m_vScrollPos, 0);
+	pRect->right  = min(m_hScrollPos + m_cliwidth, (int) m_si.framebufferWidth);
+	pRect->bottom = min(m_vScrollPos + m_cliheight, (int) m_si.framebufferHeight);
+}
+
+// Called by the main thread when the window has been scrolled or sized.
+// The parts of the new viewport which were outside the old one may not
+// have been updated for a while, so they are asked for in full.  The
+// worker thread does the asking, in place of its next incremental 
+// request, because it relies on having at most one request outstanding
+// when it changes pixel format.
+
+void ClientConnection::RequestNewlyVisible(RECT *pOldViewport)
+{
+	if (!m_running || !m_opts.m_ViewportUpdates || m_desktopResizing) return;
+
+	// Continuous updates follow the window too
+	if (m_cuState == CU_ON)
+		SendEnableContinuousUpdates(true);
+
+	RECT vp, old = *pOldViewport;
+	GetViewport(&vp);
+
+	// Bands above and below the old viewport, then the pieces to
+	// the left and right of it in between.
+	RECT strips[4];
+	int n = 0;
+	int midtop = max(vp.top, old.top), midbottom = min(vp.bottom, old.bottom);
+	if (midtop >= midbottom) {
+		strips[n++] = vp;
+	} else {
+		if (vp.top < midtop)
+			SetRect(&strips[n++], vp.left, vp.top, vp.right, midtop);
+		if (vp.bottom > midbottom)
+			SetRect(&strips[n++], vp.left, midbottom, vp.right, vp.bottom);
+		if (vp.left < old.left)
+			SetRect(&strips[n++], vp.left, midtop, min(old.left, vp.right), midbottom);
+		if (vp.right > old.right)
+			SetRect(&strips[n++], max(old.right, vp.left), midtop, vp.right, midbottom);
+	}
+
+	omni_mutex_lock l(m_writeMutex);
+	for (int i = 0; i < n; i++) {
+		if (strips[i].right <= strips[i].left || strips[i].bottom <= strips[i].top)
+			continue;
+		if (m_exposurePending) {
+			UnionRect(&m_exposedRect, &m_exposedRect, &strips[i]);
+		} else {
+			m_exposedRect = strips[i];
+			m_exposurePending = true;
+		}
+	}
+}
+
 
 
 // A ScreenUpdate message has been received
@@ -1700,16 +2516,20 @@ void ClientConnection::ReadScreenUpdate() {
 	ReadExact((char *) &sut + 1, sz_rfbFramebufferUpdateMsg-1);
     sut.nRects = Swap16IfLE(sut.nRects);
 	if (sut.nRects == 0) return;
+
+	DWORD start = GetTickCount();
+	DWORD recvTime = m_recvTime;
+	DWORD bytesRead = m_bytesRead - (m_inend - m_inptr);
 	
-	// No other threads can use DC
-	omni_mutex_lock l(m_bitmapdcMutex);
-	
-	ObjectSelector b(m_hBitmapDC, m_hBitmap);
-	PaletteSelector p(m_hBitmapDC, m_hPalette);
-	
-	// Find the bounding region of this batch of updates
-	HRGN fullregion = NULL;
-	
+	// The decoders write into the bitmap's memory directly, locking it
+	// only while they draw.  The rectangles are collected and merged, and 
+	// handed to the main thread to invalidate after the last one.  If the
+	// server is sending them as it encodes them, and will tell us which
+	// is the last, each is handed over as soon as it's drawn instead.
+	m_updateDamage.Clear();
+	m_updatePointerMoved = false;
+	bool streamed = (sut.nRects == rfbUnknownNumberOfRects);
+
 	for (UINT i=0; i < sut.nRects; i++) {
 		
 		rfbFramebufferUpdateRectHeader surh;
@@ -1719,6 +2539,24 @@ void ClientConnection::ReadScreenUpdate() {
 		surh.r.w = Swap16IfLE(surh.r.w);
 		surh.r.h = Swap16IfLE(surh.r.h);
 		surh.encoding = Swap32IfLE(surh.encoding);
+
+		if (surh.encoding == rfbEncodingLastRect)
+			break;
+		if (ReadPseudoEncoding(&surh))
+			continue;
+
+		// We write straight into memory, so we mustn't trust the
+		// server to keep within the framebuffer.
+		if (surh.r.x + surh.r.w > m_si.framebufferWidth ||
+			surh.r.y + surh.r.h > m_si.framebufferHeight) {
+			log.Print(0, _T("Rectangle %d,%d %dx%d is outside the framebuffer\n"),
+				surh.r.x, surh.r.y, surh.r.w, surh.r.h);
+			RaiseException(VNC_EXC_INVALID,0,0,0);
+		}
+
+		// Keep count of what each encoding costs us
+		DWORD encStart = GetTickCount(), encRecvTime = m_recvTime;
+		DWORD encBytes = m_bytesRead - (m_inend - m_inptr);
 		
 		switch (surh.encoding) {
 		case rfbEncodingRaw:
@@ -1736,18 +2574,293 @@ void ClientConnection::ReadScreenUpdate() {
 		case rfbEncodingHextile:
 			ReadHextileRect(&surh);
 			break;
+		case rfbEncodingZlib:
+			ReadZlibRect(&surh);
+			break;
+		case rfbEncodingZlibHex:
+			ReadZlibHexRect(&surh);
+			break;
+		case rfbEncodingTight:
+			ReadTightRect(&surh);
+			break;
+		case rfbEncodingTRLE:
+			ReadTRLERect(&surh);
+			break;
+		case rfbEncodingZRLE:
+			ReadZRLERect(&surh);
+			break;
 		default:
 			log.Print(0, _T("Unknown encoding %d - not supported!\n"), surh.encoding);
 			break;
 		}
+
+		if (surh.encoding <= LASTENCODING) {
+			m_encRects[surh.encoding]++;
+			m_encBytes[surh.encoding] += m_bytesRead - (m_inend - m_inptr) - encBytes;
+			m_encTime[surh.encoding] += 
+				(GetTickCount() - encStart) - (m_recvTime - encRecvTime);
+			m_encPixels[surh.encoding] += surh.r.w * surh.r.h;
+		}
 		
+		m_updateDamage.Add(surh.r.x, surh.r.y, surh.r.w, surh.r.h);
+		if (streamed)
+			QueueDamage();
+	}
+
+	QueueDamage();
+
+	// Time spent waiting for the network doesn't count as decoding
+	m_decodeTime += (GetTickCount() - start) - (m_recvTime - recvTime);
+
+	m_tuneUpdateBytes += m_bytesRead - (m_inend - m_inptr) - bytesRead;
+	m_tuneUpdateRecv += m_recvTime - recvTime;
+	m_depthUpdates++;
+	m_depthUpdateTime += GetTickCount() - start;
+	AutoTune();
+}
+
+// Pseudo-encodings carry something other than pixels, so their rectangles
+// aren't checked against the framebuffer or counted.  Returns false if 
+// this is an ordinary rectangle.
+
+bool ClientConnection::ReadPseudoEncoding(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	switch (pfburh->encoding) {
+	case rfbEncodingXCursor:
+	case rfbEncodingRichCursor:
+		ReadCursorShape(pfburh);
+		return true;
+	case rfbEncodingPointerPos:
+		m_updatePointerMoved = true;
+		m_updatePointerX = pfburh->r.x;
+		m_updatePointerY = pfburh->r.y;
+		return true;
+	case rfbEncodingNewFBSize:
+		ResizeDesktop(pfburh->r.w, pfburh->r.h);
+		return true;
+	case rfbEncodingExtDesktopSize:
+		ReadExtDesktopSize(pfburh);
+		return true;
+	}
+	return false;
+}
+
+// A new cursor shape.  Both the old and the new one need redrawing where 
+// the pointer is.
+
+void ClientConnection::ReadCursorShape(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	int w = pfburh->r.w, h = pfburh->r.h;
+	bool xcursor = (pfburh->encoding == rfbEncodingXCursor);
+	int maskbytes = ((w + 7) / 8) * h;
+
+	if (w > MAXCURSORSIZE || h > MAXCURSORSIZE) {
+		// We can't draw it, and the whole shape might not fit in memory,
+		// so throw it away a row at a time.  SetShape will fail below.
+		int rowbytes = xcursor ? 2 * ((w + 7) / 8) : 
+			w * m_conv.m_bytesPerPixel + (w + 7) / 8;
+		if (h > 0 && w > 0) {
+			CheckBufferSize(max(rowbytes, sz_rfbXCursorColors));
+			if (xcursor)
+				ReadExact(m_netbuf, sz_rfbXCursorColors);
+			for (int j = 0; j < h; j++)
+				ReadExact(m_netbuf, rowbytes);
+		}
+	} else {
+		int size = 0;
+		if (w > 0 && h > 0) {
+			if (xcursor)
+				size = sz_rfbXCursorColors + 2 * maskbytes;
+			else
+				size = w * h * m_conv.m_bytesPerPixel + maskbytes;
+		}
+		CheckBufferSize(size);
+		ReadExact(m_netbuf, size);
+	}
+
+	int x = m_cursorX, y = m_cursorY;
+	int left, top, right, bottom;
+	m_cursor.GetRect(x, y, left, top, right, bottom);
+	m_updateDamage.Add(left, top, right - left, bottom - top);
+
+	omni_mutex_lock l(m_bitmapdcMutex);
+	if (!m_cursor.SetShape(w, h, pfburh->r.x, pfburh->r.y)) {
+		log.Print(0, _T("Cursor too big to draw: %dx%d\n"), w, h);
+		return;
+	}
+	if (!m_cursor.IsVisible()) return;
+
+	CARD32 *pix = m_cursor.Pixels();
+	CARD8 *p = (CARD8 *) m_netbuf;
+	if (xcursor) {
+		rfbXCursorColors *colors = (rfbXCursorColors *) p;
+		CARD32 fg = PIXEL_RGB(colors->foreRed, colors->foreGreen, colors->foreBlue);
+		CARD32 bg = PIXEL_RGB(colors->backRed, colors->backGreen, colors->backBlue);
+		p += sz_rfbXCursorColors;
+		int rowbytes = m_cursor.MaskRowBytes();
+		for (int j = 0; j < h; j++) {
+			for (int i = 0; i < w; i++)
+				*pix++ = (p[i >> 3] & (0x80 >> (i & 7))) ? fg : bg;
+			p += rowbytes;
+		}
+	} else {
+		m_conv.ConvertRow(p, pix, w * h);
+		p += w * h * m_conv.m_bytesPerPixel;
+	}
+	memcpy(m_cursor.Mask(), p, maskbytes);
+
+	m_cursor.GetRect(x, y, left, top, right, bottom);
+	m_updateDamage.Add(left, top, right - left, bottom - top);
+}
+
+// Called by the main thread when the pointer moves, to redraw the 
+// cursor where it was and where it is now.
+
+void ClientConnection::MoveLocalCursor(int x, int y)
+{
+	if (x == m_cursorX && y == m_cursorY) return;
+
+	RECT oldrc, newrc;
+	int left, top, right, bottom;
+	m_cursor.GetRect(m_cursorX, m_cursorY, left, top, right, bottom);
+	SetRect(&oldrc, left - m_hScrollPos, top - m_vScrollPos + m_barheight,
+		right - m_hScrollPos, bottom - m_vScrollPos + m_barheight);
+	m_cursorX = x;
+	m_cursorY = y;
+	m_cursor.GetRect(m_cursorX, m_cursorY, left, top, right, bottom);
+	SetRect(&newrc, left - m_hScrollPos, top - m_vScrollPos + m_barheight,
+		right - m_hScrollPos, bottom - m_vScrollPos + m_barheight);
+
+	if (!m_cursor.IsVisible()) return;
+	InvalidateRect(m_hwnd, &oldrc, FALSE);
+	InvalidateRect(m_hwnd, &newrc, FALSE);
+}
+
+// We don't use the screen layout, only the overall size.
+
+void ClientConnection::ReadExtDesktopSize(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	rfbExtDesktopSizeHeader hdr;
+	ReadExact((char *) &hdr, sz_rfbExtDesktopSizeHeader);
+	int size = hdr.numberOfScreens * sz_rfbExtDesktopScreen;
+	CheckBufferSize(size);
+	ReadExact(m_netbuf, size);
+
+	// A non-zero status means a change we asked for didn't happen
+	if (pfburh->r.y != 0) return;
+	ResizeDesktop(pfburh->r.w, pfburh->r.h);
+}
+
+// Called by the worker thread when the server's desktop changes size.
+// The framebuffer is changed straight away, since the rest of the update
+// is for the new size, and the main thread sorts out the window.
+
+void ClientConnection::ResizeDesktop(int w, int h)
+{
+	if (w == m_si.framebufferWidth && h == m_si.framebufferHeight) return;
+	if (w <= 0 || h <= 0) {
+		log.Print(0, _T("Invalid desktop size %d x %d\n"), w, h);
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+	log.Print(1, _T("Desktop size changed to %d x %d\n"), w, h);
+
+	{
+		omni_mutex_lock l(m_bitmapdcMutex);
+		SizeFramebuffer(w, h);
+		m_si.framebufferWidth = w;
+		m_si.framebufferHeight = h;
+	}
+	PostMessage(m_hwnd, WM_DESKTOPRESIZED, 0, 0);
+
+	// Anything already asked for was for the old size
+	SendFullFramebufferUpdateRequest();
+	if (m_cuState == CU_ON)
+		SendEnableContinuousUpdates(true);
+}
+
+// Called by the main thread after the desktop has changed size, to work
+// out the window's limits and scroll positions again.
+
+void ClientConnection::DesktopResized()
+{
+	CalcFullWindowSize();
+	m_desktopResizing = true;
+	SendMessage(m_hwnd, WM_SIZE, 0, 0);
+	m_desktopResizing = false;
+	InvalidateRect(m_hwnd, NULL, FALSE);
+}
+
+// Called by the worker thread at the end of an update, or after each
+// rectangle of a streamed one, to pass what it changed to the main thread.
+
+void ClientConnection::QueueDamage()
+{
+	if (m_updateDamage.IsEmpty() && !m_updatePointerMoved) return;
+
+	omni_mutex_lock l(m_dirtyMutex);
+	bool wasEmpty = m_damage.IsEmpty() && !m_serverPointerMoved;
+	m_damage.Add(m_updateDamage);
+	if (m_updatePointerMoved) {
+		m_serverPointerMoved = true;
+		m_serverPointerX = m_updatePointerX;
+		m_serverPointerY = m_updatePointerY;
+	}
+	m_updateDamage.Clear();
+	m_updatePointerMoved = false;
+
+	if (wasEmpty) {
+		m_dirtySince = GetTickCount();
+		PostMessage(m_hwnd, WM_REGIONUPDATED, 0, 0);
+	}
+}
+
+// Called by the main thread to invalidate everything which has been 
+// updated.  We use the scroll position at this point, not when the 
+// rectangles were drawn, in case the window has scrolled in between.
+
+void ClientConnection::ProcessDirtyRects()
+{
+	DamageRegion damage;
+	bool pointerMoved;
+	int pointerX, pointerY;
+	{
+		omni_mutex_lock l(m_dirtyMutex);
+		if (m_damage.IsEmpty() && !m_serverPointerMoved) return;
+		damage = m_damage;
+		m_damage.Clear();
+		pointerMoved = m_serverPointerMoved;
+		pointerX = m_serverPointerX;
+		pointerY = m_serverPointerY;
+		m_serverPointerMoved = false;
+		m_queueTime += GetTickCount() - m_dirtySince;
+		m_queueDrains++;
+	}
+
+	m_rectsDamaged += damage.m_added;
+	m_rectsInvalidated += damage.Count();
+
+	for (int i = 0; i < damage.Count(); i++) {
+		const DamageRect &r = damage.Rect(i);
 		RECT rect;
-		rect.left   = surh.r.x - m_hScrollPos;
-		rect.top    = surh.r.y - m_vScrollPos + m_barheight;
-		rect.right  = rect.left + surh.r.w;
-		rect.bottom = rect.top  + surh.r.h;
+		SetRect(&rect, r.left - m_hScrollPos, r.top - m_vScrollPos + m_barheight,
+			r.right - m_hScrollPos, r.bottom - m_vScrollPos + m_barheight);
 		InvalidateRect(m_hwnd, &rect, FALSE);
 	}
+
+	if (pointerMoved)
+		ServerMovedPointer(pointerX, pointerY);
+}
+
+// Called by the main thread when the server says where the pointer is.
+
+void ClientConnection::ServerMovedPointer(int x, int y)
+{
+	// Our own movements are already shown, and may have gone further
+	for (int i = 0; i < POINTERHISTORY; i++) {
+		if (m_sentPointerX[i] == x && m_sentPointerY[i] == y)
+			return;
+	}
+	MoveLocalCursor(x, y);
 }
 
 void ClientConnection::SetDormant(bool newstate)
@@ -1804,18 +2917,51 @@ void ClientConnection::ReadBell() {
 
 // General utilities -------------------------------------------------
 
-// Reads the number of bytes specified into the buffer given
+// In debug builds, complain if anything but the reader thread tries to
+// read, since the input buffer isn't locked.
+#ifdef _DEBUG
+#define CHECK_READER_THREAD()												\
+	if (GetCurrentThreadId() != m_readerThread) {							\
+		log.Print(0, _T("Read from thread %x, but reader is %x\n"),		\
+			GetCurrentThreadId(), m_readerThread);							\
+		DebugBreak();														\
+	}
+#else
+#define CHECK_READER_THREAD()
+#endif
+
+// Reads the number of bytes specified into the buffer given.
+// Small reads are satisfied from the input buffer; large ones go
+// straight into the caller's buffer once the input buffer is empty.
 
 void ClientConnection::ReadExact(char *inbuf, int wanted)
 {
-	omni_mutex_lock l(m_readMutex);
-	// omni_mutex_lock l2(sockMutex);
-	int offset = 0;
+	CHECK_READER_THREAD();
     log.Print(10, _T("  reading %d bytes\n"), wanted);
-	
+
+	// First use anything we've already got
+	int n = min(wanted, m_inend - m_inptr);
+	if (n > 0) {
+		memcpy(inbuf, m_inptr, n);
+		m_inptr += n;
+		inbuf += n;
+		wanted -= n;
+	}
+	if (wanted == 0) return;
+
+	if (wanted < INPUTBUFSIZE) {
+		FillInputBuffer(wanted);
+		memcpy(inbuf, m_inptr, wanted);
+		m_inptr += wanted;
+		return;
+	}
+
+	int offset = 0;
+	DWORD start = GetTickCount();
 	while (wanted > 0) {
 
 		int bytes = recv(m_sock, inbuf+offset, wanted, 0);
+		m_recvCalls++;
 		if (bytes == 0) RaiseException(VNC_EXC_QUIETCLOSE,0,0,0);
 		if (bytes == SOCKET_ERROR) {
 			int err = ::GetLastError();
@@ -1823,10 +2969,101 @@ void ClientConnection::ReadExact(char *inbuf, int wanted)
 			m_running = false;
 			RaiseException(VNC_EXC_QUIETCLOSE,0,0,0);
 		}
+		m_bytesRead += bytes;
+		if (m_recorder != NULL)
+			m_recorder->Record(inbuf+offset, bytes);
 		wanted -= bytes;
 		offset += bytes;
 
 	}
+	m_recvTime += GetTickCount() - start;
+}
+
+// Like ReadExact, but rather than copying the data it returns a pointer 
+// to it in the input buffer.  The pointer is only valid until the next
+// read.  No more than INPUTBUFSIZE bytes may be asked for.
+
+char *ClientConnection::ReadExactPtr(int wanted)
+{
+	CHECK_READER_THREAD();
+    log.Print(10, _T("  reading %d bytes in place\n"), wanted);
+
+	if (m_inend - m_inptr < wanted)
+		FillInputBuffer(wanted);
+	char *p = m_inptr;
+	m_inptr += wanted;
+	return p;
+}
+
+const CARD8 *SocketByteSource::Get(int n)
+{
+	return (const CARD8 *) m_cc->ReadExactPtr(n);
+}
+
+// Make sure there are at least the given number of bytes in the input
+// buffer, reading as much as the socket will give us each time.
+// Must be called from the reader thread.
+
+void ClientConnection::FillInputBuffer(int wanted)
+{
+	if (wanted > INPUTBUFSIZE) {
+		log.Print(0, _T("Can't buffer %d bytes\n"), wanted);
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+
+	// Move what's left to the start to make room
+	int have = m_inend - m_inptr;
+	if (m_inptr != m_inbuf) {
+		memmove(m_inbuf, m_inptr, have);
+		m_inptr = m_inbuf;
+		m_inend = m_inbuf + have;
+	}
+
+	DWORD start = GetTickCount();
+	while (have < wanted) {
+
+		int bytes = recv(m_sock, m_inend, INPUTBUFSIZE - have, 0);
+		m_recvCalls++;
+		if (bytes == 0) RaiseException(VNC_EXC_QUIETCLOSE,0,0,0);
+		if (bytes == SOCKET_ERROR) {
+			int err = ::GetLastError();
+			log.Print(1, _T("Socket error while reading %d\n"), err);
+			m_running = false;
+			RaiseException(VNC_EXC_QUIETCLOSE,0,0,0);
+		}
+		m_bytesRead += bytes;
+		if (m_recorder != NULL)
+			m_recorder->Record(m_inend, bytes);
+		m_inend += bytes;
+		have += bytes;
+
+	}
+	m_recvTime += GetTickCount() - start;
+}
+
+// Start recording everything the server sends from the ServerInit
+// message on.  It is preceded by a protocol version and security type
+// as a server without authentication would send, so that the file can be
+// played back as a session of its own.  Anything already read into the
+// input buffer is recorded first.  Called by the main thread before it
+// reads the ServerInit message.
+
+void ClientConnection::StartRecording()
+{
+	m_recorder = new SessionRecorder();
+	if (!m_recorder->Open(m_opts.m_recordFilename)) {
+		delete m_recorder;
+		m_recorder = NULL;
+		return;
+	}
+
+	char handshake[sz_rfbProtocolVersionMsg + 4];
+	sprintf(handshake, rfbProtocolVersionFormat, 3, 3);
+	CARD32 authScheme = Swap32IfLE(rfbNoAuth);
+	memcpy(&handshake[sz_rfbProtocolVersionMsg], &authScheme, 4);
+	m_recorder->Record(handshake, sizeof(handshake));
+	if (m_inend > m_inptr)
+		m_recorder->Record(m_inptr, m_inend - m_inptr);
 }
 
 // Read the number of bytes and return them zero terminated in the buffer 
@@ -1839,28 +3076,85 @@ void ClientConnection::ReadString(char *buf, int length)
 }
 
 
-// Sends the number of bytes specified from the buffer
+// Queues the message in the given buffer to be sent.  Unless a batch
+// is being gathered, it goes straight away.  WinSock 1.1 has no 
+// gathering send, so we copy messages into one buffer instead.
 void ClientConnection::WriteExact(char *buf, int bytes)
 {
 	if (bytes == 0) return;
 	
 	omni_mutex_lock l(m_writeMutex);
 	log.Print(10, _T("  writing %d bytes\n"), bytes);
+	m_messagesWritten++;
+
+	// Keep things in order if there isn't room
+	if (m_outbufLen + bytes > OUTPUTBUFSIZE)
+		FlushOutput();
+
+	if (bytes > OUTPUTBUFSIZE) {
+		SendExact(buf, bytes);
+		return;
+	}
+
+	memcpy(m_outbuf + m_outbufLen, buf, bytes);
+	m_outbufLen += bytes;
+
+	if (m_writeBatchDepth == 0)
+		FlushOutput();
+}
+
+// Hold back messages until the matching EndWriteBatch.  These nest.
+// A batch should only cover the handling of one input event, since 
+// messages from the other thread get held back too.  If sending fails
+// the batches are abandoned, and so their EndWriteBatch may not come.
+void ClientConnection::BeginWriteBatch()
+{
+	omni_mutex_lock l(m_writeMutex);
+	m_writeBatchDepth++;
+}
+
+void ClientConnection::EndWriteBatch()
+{
+	omni_mutex_lock l(m_writeMutex);
+	if (m_writeBatchDepth > 0 && --m_writeBatchDepth == 0)
+		FlushOutput();
+}
 
+// Send anything waiting in the output buffer.
+// Must be called with m_writeMutex held.
+void ClientConnection::FlushOutput()
+{
+	if (m_outbufLen == 0) return;
+	int len = m_outbufLen;
+	m_outbufLen = 0;
+	m_outputFlushes++;
+	SendExact(m_outbuf, len);
+}
+
+// Sends the number of bytes specified from the buffer
+// Must be called with m_writeMutex held.
+void ClientConnection::SendExact(char *buf, int bytes)
+{
 	int i = 0;
     int j;
 
     while (i < bytes) {
 
 		j = send(m_sock, buf+i, bytes-i, 0);
+		m_sendCalls++;
 		if (j == SOCKET_ERROR || j==0) {
 			int err = ::GetLastError();
 			log.Print(1, _T("Socket error %d\n"), err);
 			m_running = false;
 
+			// The exception skips any EndWriteBatch calls, so don't 
+			// leave later messages waiting for them.
+			m_writeBatchDepth = 0;
+			m_outbufLen = 0;
 			RaiseException(VNC_EXC_QUIETCLOSE,0,0,0);
 		}
 		i += j;
+		m_bytesWritten += j;
     }
 }
 
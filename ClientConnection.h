@@ -33,9 +33,61 @@
 #include "VNCOptions.h"
 #include "VNCviewerApp.h"
 #include "KeyMap.h"
+#include "PixelBuffer.h"
+#include "PixelConverter.h"
+#include "DamageRegion.h"
+#include "ZlibInStream.h"
+#include "RLETileDecoder.h"
+#include "LocalCursor.h"
+#include "SessionRecorder.h"
 
 #define SETTINGS_KEY_NAME "Software\\ORL\\VNCviewer\\Settings"
 
+// Size of the buffer which data from the server is read into.
+#define INPUTBUFSIZE 8192
+// Size of the buffer in which messages to the server are gathered.
+#define OUTPUTBUFSIZE 1024
+// How many of the pointer positions we've sent are remembered
+#define POINTERHISTORY 8
+// The bitmap is grown in steps of this many pixels when the desktop grows
+#define FBGROWSTEP 128
+// Limits on how many fences may be waiting for replies during continuous
+// updates before we go back to asking for updates
+#define MINFENCEWINDOW 2
+#define MAXFENCEWINDOW 16
+// How often, in ms, the encoding is reconsidered, and how much must have 
+// arrived since the last time for the measurements to be used
+#define AUTOSELECTINTERVAL 5000
+#define AUTOSELECTMINPIXELS 65536
+#define AUTOSELECTMINBYTES 32768
+// Pixels are made smaller when updates take longer than AUTODEPTHSLOW ms
+// to arrive over a link slower than AUTODEPTHSLOWBANDWIDTH bytes per ms,
+// and bigger again when updates twice the size would still take less 
+// than AUTODEPTHFAST ms, or the link is faster than AUTODEPTHFASTBANDWIDTH.
+// Nothing changes for AUTODEPTHHOLD ms after a change.
+#define AUTODEPTHSLOW 400
+#define AUTODEPTHFAST 100
+#define AUTODEPTHSLOWBANDWIDTH 128
+#define AUTODEPTHFASTBANDWIDTH 512
+#define AUTODEPTHHOLD 20000
+// How often, in ms, a line is added to the statistics file, and the 
+// longest it can be
+#define STATSINTERVAL 10000
+#define STATSLINESIZE 2048
+
+class ClientConnection;
+
+// Bytes read straight from the server, in place in the input buffer,
+// for decoders which can also take their data from a decompressor.
+class SocketByteSource : public ByteSource
+{
+public:
+	void Attach(ClientConnection *cc) { m_cc = cc; };
+	virtual const CARD8 *Get(int n);
+private:
+	ClientConnection *m_cc;
+};
+
 class ClientConnection  : public omni_thread
 {
 public:
@@ -72,22 +124,58 @@ private:
 	void ReadServerInit();
 	void SendClientInit();
 	void CreateLocalFramebuffer();
+	void SizeFramebuffer(int w, int h);
+	void CalcFullWindowSize();
 	
 	void SetupPixelFormat();
 	void SetFormatAndEncodings();
+	void SendEncodings();
+	void ResetAutoSelect();
+	void AutoTune();
+	void AutoSelectEncoding();
+	void AutoSelectDepth();
 	void SendSetPixelFormat(rfbPixelFormat newFormat);
 
 	void SendIncrementalFramebufferUpdateRequest();
 	void SendFullFramebufferUpdateRequest();
 	void SendFramebufferUpdateRequest(int x, int y, int w, int h, bool incremental);
+	void GetViewport(RECT *pRect);
+	void RequestNewlyVisible(RECT *pOldViewport);
 	
 	void ProcessPointerEvent(int x, int y, DWORD keyflags);
 	void SendPointerEvent(int x, int y, int buttonMask);
+	void FlushPointerEvent();
     void ProcessKeyEvent(int virtkey, DWORD keyData);
 	void SendKeyEvent(CARD32 key, bool down);
 	
 	void ReadScreenUpdate();
+	bool ReadPseudoEncoding(rfbFramebufferUpdateRectHeader *pfburh);
+	void ReadCursorShape(rfbFramebufferUpdateRectHeader *pfburh);
+	void MoveLocalCursor(int x, int y);
+	void ServerMovedPointer(int x, int y);
+	void ReadExtDesktopSize(rfbFramebufferUpdateRectHeader *pfburh);
+	void ResizeDesktop(int w, int h);
+	void ChangePixelFormat();
+	void ReadEndOfContinuousUpdates();
+	void ReadFence();
+	void SendFence(CARD32 flags, int len, const char *payload);
+	void SendSyncFenceReply();
+	void SendEnableContinuousUpdates(bool enable);
+	void CheckContinuousUpdates();
+	void StopContinuousUpdates();
+	void ContinuousUpdateReceived();
+
+	void UpdateRequestAnswered();
+	void FormatStats(TCHAR *buf, int len);
+	void OpenStatsFile();
+	void WriteStats();
+	void WriteStatsLine(TCHAR *line);
+	void CloseStatsFile();
+	void StartRecording();
+	void DesktopResized();
 	void Update(RECT *pRect);
+	void QueueDamage();
+	void ProcessDirtyRects();
 	bool ScrollScreen(int dx, int dy);
 	void UpdateScrollbars();
     
@@ -99,6 +187,22 @@ private:
 	void HandleHextileEncoding8(int x, int y, int w, int h);
 	void HandleHextileEncoding16(int x, int y, int w, int h);
 	void HandleHextileEncoding32(int x, int y, int w, int h);
+	bool HandleHextileTile(ByteSource *src, CARD8 subencoding, int x, int y, int w, int h);
+	bool HandleHextileTile8(ByteSource *src, CARD8 subencoding, int x, int y, int w, int h);
+	bool HandleHextileTile16(ByteSource *src, CARD8 subencoding, int x, int y, int w, int h);
+	bool HandleHextileTile32(ByteSource *src, CARD8 subencoding, int x, int y, int w, int h);
+	void ReadZlibHexRect(rfbFramebufferUpdateRectHeader *pfburh);
+	void ReadZRLERect(rfbFramebufferUpdateRectHeader *pfburh);
+	void ReadTRLERect(rfbFramebufferUpdateRectHeader *pfburh);
+	void ReadZlibRect(rfbFramebufferUpdateRectHeader *pfburh);
+	void ReadTightRect(rfbFramebufferUpdateRectHeader *pfburh);
+	int ReadCompactLen();
+	void DecodeTightRows(ByteSource *src, int filter, int numColors, int x, int y, int w, int h);
+	void TightGradientRow(const CARD8 *src, CARD32 *dst, int w);
+	bool DecodeTightJpeg(const CARD8 *data, int len, int x, int y, int w, int h);
+	inline CARD32 TightPixelAt(const CARD8 *p) {
+		return m_tightCutZeros ? PIXEL_RGB(p[0], p[1], p[2]) : m_conv.PixelAt(p);
+	};
 	
 	void ReadRBSRect(rfbFramebufferUpdateRectHeader *pfburh);
 	BOOL DrawRBSRect8(int x, int y, int w, int h, CARD8 **pptr);
@@ -118,8 +222,15 @@ private:
 	
 	void SendRFBMsg(CARD8 msgType, void* data, int length);
 	void ReadExact(char *buf, int bytes);
+	char *ReadExactPtr(int bytes);
+	friend class SocketByteSource;
 	void ReadString(char *buf, int length);
+	void FillInputBuffer(int wanted);
 	void WriteExact(char *buf, int bytes);
+	void SendExact(char *buf, int bytes);
+	void FlushOutput();
+	void BeginWriteBatch();
+	void EndWriteBatch();
 
 	// This is what controls the thread
 	void * run_undetached(void* arg);
@@ -127,22 +238,41 @@ private:
 
 	// Utilities
 
-	// These draw a solid rectangle of colour on the bitmap
-	// They assume the bitmap is already selected into the DC, and the
-	// DC is locked if necessary.
-	inline void FillSolidRect(RECT *pRect, COLORREF color) {
-		COLORREF oldbgcol = SetBkColor(m_hBitmapDC, color);
-		// This is the call MFC uses for FillSolidRect. Who am I to argue?
-		::ExtTextOut(m_hBitmapDC, 0, 0, ETO_OPAQUE, pRect, NULL, 0, NULL);			
+	// These draw a solid rectangle of colour on the bitmap.
+	// The colour is a framebuffer pixel value, not a COLORREF.
+	// They write straight into the bitmap's memory, so the caller
+	// must hold m_bitmapdcMutex.
+	inline void FillSolidRect(int x, int y, int w, int h, CARD32 color) {
+		m_fb.FillRect(x, y, w, h, color);
 	};
 
-	inline void FillSolidRect(int x, int y, int w, int h, COLORREF color) {
-		RECT r;
-		r.left = x;		r.right = x + w;
-		r.top = y;		r.bottom = y + h;
-		FillSolidRect(&r, color);
+	inline void FillSolidRect(RECT *pRect, CARD32 color) {
+		FillSolidRect(pRect->left, pRect->top,
+			pRect->right - pRect->left, pRect->bottom - pRect->top, color);
 	};
 
+	// Pointer movements which arrive sooner than m_opts.m_PointerInterval
+	// after the last one sent are held here, and only the latest is sent 
+	// when the pointer timer fires.  A change of buttons is always sent 
+	// straight away.  Only the main thread uses these.
+	int m_pointerX, m_pointerY, m_pointerMask;
+	bool m_pointerPending, m_pointerTimerSet;
+	DWORD m_lastPointerTime;
+	// Pointer events from Windows, and pointer events sent to the server
+	DWORD m_pointerEventsIn, m_pointerEventsSent;
+
+	// The server's cursor, which DoBlit draws over the framebuffer with 
+	// its hotspot at m_cursorX,m_cursorY, in framebuffer coordinates.  The
+	// shape is set by the worker thread with m_bitmapdcMutex held, and
+	// the position is only used by the main thread.
+	LocalCursor m_cursor;
+	int m_cursorX, m_cursorY;
+	// The cursor follows our own pointer movements straight away, and 
+	// follows the server's PointerPos updates unless they are just our 
+	// own recent positions coming back, which would make it jump back.
+	int m_sentPointerX[POINTERHISTORY], m_sentPointerY[POINTERHISTORY];
+	int m_sentPointerNext;
+
     // how many other windows are owned by this process?
     unsigned int CountProcessOtherWindows();
 
@@ -150,14 +280,78 @@ private:
 	void CheckBufferSize(int bufsize);
 	char *m_netbuf;
 	int m_netbufsize;
+
+	// Data received from the server but not yet used.  We recv as much 
+	// as we can into here, and ReadExact takes it out, so that reading
+	// small fields doesn't cost a system call each.
+	char *m_inbuf, *m_inptr, *m_inend;
+	// How many times we've called recv, and how many bytes it gave us
+	DWORD m_recvCalls, m_bytesRead;
+	// If we're recording the session, everything recv gives us is also
+	// handed to this
+	SessionRecorder *m_recorder;
+	// Only one thread ever reads from the socket, so the input side has 
+	// no lock.  The main thread reads during the initial negotiation and
+	// then hands over to the worker thread.  Debug builds check this.
+	DWORD m_readerThread;
+
+	// Messages to the server are gathered in here.  Between 
+	// BeginWriteBatch and EndWriteBatch they are held back, so that 
+	// everything produced by one input event goes in a single send.
+	// Otherwise each message is sent as soon as it is written.
+	char m_outbuf[OUTPUTBUFSIZE];
+	int m_outbufLen;
+	int m_writeBatchDepth;
+	// Messages written, sends of the output buffer, calls to send, and 
+	// the bytes they sent
+	DWORD m_messagesWritten, m_outputFlushes, m_sendCalls, m_bytesWritten;
+	// When the oldest unanswered update request was sent, and how long 
+	// the last and all the answered ones took.  m_writeMutex protects 
+	// these.
+	bool m_requestOutstanding;
+	DWORD m_requestTime, m_requestRTT, m_requestRTTTotal, m_requestRTTs;
+
+	// Areas of the framebuffer changed by the update being read.  Only
+	// the worker thread uses this.
+	DamageRegion m_updateDamage;
+	// Where the update being read says the pointer has gone, if anywhere
+	bool m_updatePointerMoved;
+	int m_updatePointerX, m_updatePointerY;
+	// Areas of the framebuffer which have been updated, in framebuffer
+	// coordinates.  The worker thread adds each update's damage after its
+	// last rectangle, and the main thread invalidates it in the window 
+	// when it gets WM_REGIONUPDATED, which is posted when the region 
+	// stops being empty.  m_dirtySince is when that was.
+	DamageRegion m_damage;
+	DWORD m_dirtySince;
+	// The pointer position from the server, handed over the same way
+	bool m_serverPointerMoved;
+	int m_serverPointerX, m_serverPointerY;
+	// Rectangles received, and the invalidations they were merged into
+	DWORD m_rectsDamaged, m_rectsInvalidated;
+
+	// Milliseconds spent in each stage: waiting for data, decoding it,
+	// waiting in the dirty queue, and painting.
+	DWORD m_recvTime, m_decodeTime, m_queueTime, m_paintTime;
+	DWORD m_queueDrains, m_paints;
+
+	// m_bitmapdcMutex protects the framebuffer's pixels.  The decoders
+	// hold it only while drawing each band or tile, so that painting 
+	// can go on in between.
 	omni_mutex m_bufferMutex, 
 		m_bitmapdcMutex,  m_clipMutex,
-        m_readMutex, m_writeMutex;
+        m_writeMutex, m_dirtyMutex;
 
-	// Bitmap for local copy of screen, and DC for writing to it.
+	// Bitmap for local copy of screen, and DC for blitting from it.
+	// The bitmap is a DIB section, and m_fb describes its pixels so
+	// that the decoders can write to them directly.
 	HBITMAP m_hBitmap;
+	// The size of the bitmap, which may be bigger than the framebuffer
+	// if the desktop has shrunk
+	int m_fbCapWidth, m_fbCapHeight;
 	HDC		m_hBitmapDC;
 	HPALETTE m_hPalette;
+	PixelBuffer m_fb;
 
 	// Keyboard mapper
 	KeyMap m_keymap;
@@ -167,6 +361,52 @@ private:
 	TCHAR *m_desktopName;
 	rfbServerInitMsg m_si;
 	rfbPixelFormat m_myFormat, m_pendingFormat;
+	// Converts pixels in m_myFormat into framebuffer pixels
+	PixelConverter m_conv;
+	// ZRLE uses one zlib stream for the whole connection
+	ZlibInStream m_zrleStream;
+	RLETileDecoder m_rleDecoder;
+	// TRLE tiles come straight off the network, so each is decoded into
+	// a buffer of its own and only the finished tile is drawn.
+	RLETileDecoder m_trleDecoder;
+	PixelBuffer m_trleTile;
+	CARD32 m_trleTileBits[rfbTRLETileWidth * rfbTRLETileHeight];
+	// Zlib has one of its own
+	ZlibInStream m_zlibStream;
+	// ZlibHex has one for raw tiles and one for Hextile-encoded ones
+	ZlibInStream m_zlibHexRawStream, m_zlibHexEncStream;
+	SocketByteSource m_socketSource;
+	// Hextile's colours carry on from one tile to the next
+	CARD32 m_hextileBg, m_hextileFg;
+	// Tight uses four, and the server says which each rectangle uses.
+	ZlibInStream m_tightStreams[4];
+	CARD32 m_tightPalette[256];
+	// Whether Tight sends pixels as 3 bytes of red, green and blue
+	bool m_tightCutZeros;
+	// The colour components of the row above, for the gradient filter
+	CARD16 m_tightPrevRow[rfbTightMaxRectWidth * 3];
+
+	// For each encoding, the rectangles, bytes and decoding time
+	DWORD m_encRects[LASTENCODING+1], m_encBytes[LASTENCODING+1], 
+		m_encTime[LASTENCODING+1], m_encPixels[LASTENCODING+1];
+
+	// The encoding chosen from what the others have been measured to 
+	// cost, or -1 to use the preferred one.  For each encoding, the 
+	// estimated bytes and microseconds of decoding per thousand pixels, 
+	// and the totals when they were last estimated.
+	int m_autoEncoding;
+	DWORD m_tuneBytesPerKP[LASTENCODING+1], m_tuneUsPerKP[LASTENCODING+1];
+	DWORD m_tuneLastBytes[LASTENCODING+1], m_tuneLastTime[LASTENCODING+1],
+		m_tuneLastPixels[LASTENCODING+1];
+	// Bytes of updates received and ms spent waiting for them since the 
+	// last estimate, and the bandwidth in bytes per ms
+	DWORD m_tuneUpdateBytes, m_tuneUpdateRecv, m_tuneBandwidth;
+	DWORD m_tuneTime, m_tuneSwitches;
+	// The bits per pixel chosen for the link's speed, or 0 for the 
+	// server's own format.  The updates read since the depth was last 
+	// considered and the ms they took, and when it last changed.
+	int m_autoDepth;
+	DWORD m_depthUpdates, m_depthUpdateTime, m_depthChangeTime, m_depthChanges;
 	// protocol version in use.
 	int m_majorVersion, m_minorVersion;
 	bool m_threadStarted, m_running;
@@ -186,6 +426,48 @@ private:
 	// The size of the CE CommandBar
 	int m_barheight;
 
+	// When we last asked for the whole desktop rather than just the part
+	// in the window, and how many of each kind of request we've sent.
+	DWORD m_lastBackgroundRequest;
+	DWORD m_viewportRequests, m_backgroundRequests, m_exposureRequests;
+	// The bounds of what has been scrolled or sized into view since the
+	// worker thread last asked for it.  m_writeMutex protects these.
+	bool m_exposurePending;
+	RECT m_exposedRect;
+	// Set by the main thread while it fits the window to a new desktop
+	// size, all of which the worker thread has already asked for.
+	bool m_desktopResizing;
+	// When the worker thread started, for the data and update rates
+	DWORD m_connectTime;
+	DWORD m_updatesReceived;
+	// The statistics file, whether it's JSON rather than CSV, and when 
+	// and at how many updates the last line was written.  Only the main
+	// thread uses these.
+	HANDLE m_statsFile;
+	bool m_statsJSON;
+	DWORD m_lastStatsTime, m_lastStatsUpdates;
+
+	// Continuous updates are used if the server supports them and fences,
+	// and it then sends updates without being asked.  We send a fence 
+	// after each update, which comes back once we've read everything the
+	// server sent before it.  If more are outstanding than the window, 
+	// which is enough to cover the shortest round trip seen, we're falling
+	// behind, so we go back to asking for updates until they come back.
+	// We also stop them to change pixel format or while dormant.  Only the
+	// worker thread changes these.
+	enum { CU_OFF, CU_ON, CU_STOPPING } m_cuState;
+	bool m_supportsCU, m_supportsFence, m_cuThrottled;
+	int m_fencesInFlight, m_fenceWindow;
+	DWORD m_fenceRTT, m_minFenceRTT, m_updateInterval, m_lastCUUpdate;
+	DWORD m_fencesSent, m_cuThrottles;
+	// The reply to a fence with SyncNext set, which waits until the 
+	// message after the fence has been dealt with.  m_syncFenceWait 
+	// counts down the messages to go, including the fence itself.
+	int m_syncFenceWait;
+	CARD32 m_syncFenceFlags;
+	int m_syncFenceLength;
+	char m_syncFencePayload[rfbFenceMaxPayload];
+
 	// Dormant basically means minimized; updates will not be requested 
 	// while dormant.
 	void SetDormant(bool newstate);
@@ -198,63 +480,28 @@ private:
 	bool m_initialClipboardSeen;		
 };
 
-// Colour decoding utility functions
-// Define rs,rm, bs,bm, gs & gm before using, eg with the following:
-
-#define SETUP_COLOR_SHORTCUTS \
-	 CARD8 rs = m_myFormat.redShift;   CARD16 rm = m_myFormat.redMax;   \
-     CARD8 gs = m_myFormat.greenShift; CARD16 gm = m_myFormat.greenMax; \
-     CARD8 bs = m_myFormat.blueShift;  CARD16 bm = m_myFormat.blueMax;  \
+// Colour decoding utility macros.
+// These use the connection's PixelConverter, which is set up for 
+// m_myFormat by SetFormatAndEncodings, and return framebuffer pixels.
 
 // read a pixel from the given address, and return a color value
-#define COLOR_FROM_PIXEL8_ADDRESS(p) (PALETTERGB( \
-                (int) (((*(CARD8 *)p >> rs) & rm) * 255 / rm), \
-                (int) (((*(CARD8 *)p >> gs) & gm) * 255 / gm), \
-                (int) (((*(CARD8 *)p >> bs) & bm) * 255 / bm) ))
-
-#define COLOR_FROM_PIXEL16_ADDRESS(p) (PALETTERGB( \
-                (int) ((( *(CARD16 *)p >> rs) & rm) * 255 / rm), \
-                (int) ((( *(CARD16 *)p >> gs) & gm) * 255 / gm), \
-                (int) ((( *(CARD16 *)p >> bs) & bm) * 255 / bm) ))
-
-#define COLOR_FROM_PIXEL32_ADDRESS(p) (PALETTERGB( \
-                (int) ((( *(CARD32 *)p >> rs) & rm) * 255 / rm), \
-                (int) ((( *(CARD32 *)p >> gs) & gm) * 255 / gm), \
-                (int) ((( *(CARD32 *)p >> bs) & bm) * 255 / bm) ))
+#define COLOR_FROM_PIXEL8_ADDRESS(p)  (m_conv.PixelAt((CARD8 *) (p)))
+#define COLOR_FROM_PIXEL16_ADDRESS(p) (m_conv.PixelAt((CARD8 *) (p)))
+#define COLOR_FROM_PIXEL32_ADDRESS(p) (m_conv.PixelAt((CARD8 *) (p)))
 
 // The following may be faster if you already have a pixel value of the appropriate size
-#define COLOR_FROM_PIXEL8(p) (PALETTERGB( \
-                (int) (((p >> rs) & rm) * 255 / rm), \
-                (int) (((p >> gs) & gm) * 255 / gm), \
-                (int) (((p >> bs) & bm) * 255 / bm) ))
-
-#define COLOR_FROM_PIXEL16(p) (PALETTERGB( \
-                (int) ((( p >> rs) & rm) * 255 / rm), \
-                (int) ((( p >> gs) & gm) * 255 / gm), \
-                (int) ((( p >> bs) & bm) * 255 / bm) ))
-
-#define COLOR_FROM_PIXEL32(p) (PALETTERGB( \
-                (int) (((p >> rs) & rm) * 255 / rm), \
-                (int) (((p >> gs) & gm) * 255 / gm), \
-                (int) (((p >> bs) & bm) * 255 / bm) ))
-
+#define COLOR_FROM_PIXEL8(p)  (m_conv.Pixel8(p))
+#define COLOR_FROM_PIXEL16(p) (m_conv.Pixel16(p))
+#define COLOR_FROM_PIXEL32(p) (m_conv.Pixel32(p))
 
-#ifdef UNDER_CE
-#define SETPIXEL(b,x,y,c) SetPixel((b),(x),(y),(c))
-#else
-#define SETPIXEL(b,x,y,c) SetPixelV((b),(x),(y),(c))
-#endif
-
-#define SETPIXELS(bpp, x, y, w, h)												\
+// Convert a block of w x h pixels starting at buf and write them
+// straight into the local framebuffer at (x,y), a row at a time.
+#define SETPIXELS(buf, x, y, w, h)												\
 	{																			\
-		CARD##bpp *p = (CARD##bpp *) m_netbuf;									\
-        register CARD##bpp pix;													\
+		CARD8 *p = (CARD8 *) (buf);												\
+		int rowbytes = (w) * m_conv.m_bytesPerPixel;							\
 		for (int k = y; k < y+h; k++) {											\
-			for (int j = x; j < x+w; j++) {										\
-                    pix = *p;													\
-                    SETPIXEL(m_hBitmapDC, j,k, COLOR_FROM_PIXEL##bpp##(pix));	\
-					p++;														\
-			}																	\
+			m_conv.ConvertRow(p, m_fb.Row(k) + (x), w);							\
+			p += rowbytes;														\
 		}																		\
 	}
-
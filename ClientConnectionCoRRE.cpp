@@ -42,9 +42,8 @@ void ClientConnection::ReadCoRRERect(rfbFramebufferUpdateRectHeader *pfburh)
 
 	prreh->nSubrects = Swap32IfLE(prreh->nSubrects);
 
-	SETUP_COLOR_SHORTCUTS;
 
-    COLORREF color;
+    CARD32 color;
     switch (m_myFormat.bitsPerPixel) {
         case 8:
             color = COLOR_FROM_PIXEL8_ADDRESS(pcolor); break;
@@ -55,10 +54,11 @@ void ClientConnection::ReadCoRRERect(rfbFramebufferUpdateRectHeader *pfburh)
             color = COLOR_FROM_PIXEL32_ADDRESS(pcolor); break;
     }
 
-    // Draw the background of the rectangle
-    FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
-
-    if (prreh->nSubrects == 0) return;
+    if (prreh->nSubrects == 0) {
+		omni_mutex_lock l(m_bitmapdcMutex);
+		FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
+		return;
+	}
 
 	// Draw the sub-rectangles
     rfbCoRRERectangle *pRect;
@@ -72,6 +72,13 @@ void ClientConnection::ReadCoRRERect(rfbFramebufferUpdateRectHeader *pfburh)
     ReadExact(m_netbuf, subRectSize * prreh->nSubrects);
 	BYTE *p = (BYTE *) m_netbuf;
 
+	// Only lock the framebuffer once we have all the data, so that
+	// painting isn't held up while we wait for the network.
+	omni_mutex_lock l(m_bitmapdcMutex);
+
+    // Draw the background of the rectangle
+    FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
+
     for (CARD32 i = 0; i < prreh->nSubrects; i++) {
         pRect = (rfbCoRRERectangle *) (p + m_minPixelBytes);
 
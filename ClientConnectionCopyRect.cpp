@@ -32,9 +32,8 @@ void ClientConnection::ReadCopyRect(rfbFramebufferUpdateRectHeader *pfburh) {
 	cr.srcX = Swap16IfLE(cr.srcX); 
 	cr.srcY = Swap16IfLE(cr.srcY);
 	
-	if (!BitBlt(
-		m_hBitmapDC,pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h,
-		m_hBitmapDC, cr.srcX, cr.srcY, SRCCOPY)) {
-		log.Print(0, _T("Error in blit in ClientConnection::CopyRect\n"));
-	}
+	// The framebuffer copes with overlapping source and destination.
+	omni_mutex_lock l(m_bitmapdcMutex);
+	m_fb.CopyRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h,
+		cr.srcX, cr.srcY);
 }
@@ -45,20 +45,30 @@ void ClientConnection::ReadHextileRect(rfbFramebufferUpdateRectHeader *pfburh)
 }
 
 
+// Tiles may come straight from the server or out of ZlibHex's zlib 
+// streams, so they're read through a ByteSource.  Each tile's data is 
+// read before the framebuffer is locked to draw it, so that painting is
+// never held up waiting for the network.
+
+bool ClientConnection::HandleHextileTile(ByteSource *src, CARD8 subencoding, 
+										 int x, int y, int w, int h)
+{
+	switch (m_myFormat.bitsPerPixel) {
+	case 8:
+		return HandleHextileTile8(src, subencoding, x, y, w, h);
+	case 16:
+		return HandleHextileTile16(src, subencoding, x, y, w, h);
+	case 32:
+		return HandleHextileTile32(src, subencoding, x, y, w, h);
+	}
+	return false;
+}
+
 #define DEFINE_HEXTILE(bpp)                                                   \
 void ClientConnection::HandleHextileEncoding##bpp(int rx, int ry, int rw, int rh)                    \
 {                                                                             \
-    CARD##bpp bg, fg;                                                         \
-	COLORREF bgcolor, fgcolor;												  \
-    int i;                                                                    \
-    CARD8 *ptr;                                                               \
     int x, y, w, h;                                                           \
-    int sx, sy, sw, sh;                                                       \
     CARD8 subencoding;                                                        \
-    CARD8 nSubrects;                                                          \
-																			  \
-    CheckBufferSize( 16 * 16 * bpp );										  \
-	SETUP_COLOR_SHORTCUTS;                                                    \
                                                                               \
     for (y = ry; y < ry+rh; y += 16) {                                        \
         for (x = rx; x < rx+rw; x += 16) {                                    \
@@ -69,60 +79,73 @@ void ClientConnection::HandleHextileEncoding##bpp(int rx, int ry, int rw, int rh
                 h = ry+rh - y;                                                \
                                                                               \
             ReadExact((char *)&subencoding, 1);                               \
+            HandleHextileTile##bpp(&m_socketSource, subencoding, x, y, w, h); \
+        }                                                                     \
+    }                                                                         \
+}                                                                             \
                                                                               \
-            if (subencoding & rfbHextileRaw) {                                \
-                ReadExact(m_netbuf, w * h * (bpp / 8));                       \
-                SETPIXELS(bpp, x,y,w,h)                                       \
-                continue;                                                     \
-            }                                                                 \
+bool ClientConnection::HandleHextileTile##bpp(ByteSource *src, CARD8 subencoding, \
+                                              int x, int y, int w, int h)     \
+{                                                                             \
+    int i;                                                                    \
+    const CARD8 *ptr;                                                         \
+    int sx, sy, sw, sh;                                                       \
+    CARD8 nSubrects;                                                          \
                                                                               \
-		    if (subencoding & rfbHextileBackgroundSpecified) {                \
-                ReadExact((char *)&bg, (bpp/8));                              \
-				bgcolor = COLOR_FROM_PIXEL##bpp##_ADDRESS(&bg);  			  \
-			}																  \
-            FillSolidRect(x,y,w,h,bgcolor);                                   \
+    if (subencoding & rfbHextileRaw) {                                        \
+        if ((ptr = src->Get(w * h * (bpp / 8))) == NULL) return false;        \
+        omni_mutex_lock l(m_bitmapdcMutex);                                   \
+        SETPIXELS(ptr, x,y,w,h)                                               \
+        return true;                                                          \
+    }                                                                         \
                                                                               \
-            if (subencoding & rfbHextileForegroundSpecified)  {               \
-                ReadExact((char *)&fg, (bpp/8));                              \
-				fgcolor = COLOR_FROM_PIXEL##bpp##_ADDRESS(&fg);				  \
-			}                                                                 \
+    if (subencoding & rfbHextileBackgroundSpecified) {                        \
+        if ((ptr = src->Get(bpp/8)) == NULL) return false;                    \
+        m_hextileBg = COLOR_FROM_PIXEL##bpp##_ADDRESS(ptr);                   \
+    }                                                                         \
                                                                               \
-            if (!(subencoding & rfbHextileAnySubrects)) {                     \
-                continue;                                                     \
-            }                                                                 \
+    if (subencoding & rfbHextileForegroundSpecified)  {                       \
+        if ((ptr = src->Get(bpp/8)) == NULL) return false;                    \
+        m_hextileFg = COLOR_FROM_PIXEL##bpp##_ADDRESS(ptr);                   \
+    }                                                                         \
                                                                               \
-            ReadExact( (char *)&nSubrects, 1) ;                               \
+    nSubrects = 0;                                                            \
+    if (subencoding & rfbHextileAnySubrects) {                                \
+        if ((ptr = src->Get(1)) == NULL) return false;                        \
+        nSubrects = *ptr;                                                     \
+    }                                                                         \
                                                                               \
-            ptr = (CARD8 *)m_netbuf;                                          \
+    if (subencoding & rfbHextileSubrectsColoured) {                           \
                                                                               \
-            if (subencoding & rfbHextileSubrectsColoured) {                   \
-				                                                              \
-                ReadExact( m_netbuf, nSubrects * (2 + (bpp / 8)));              \
+        if ((ptr = src->Get(nSubrects * (2 + (bpp / 8)))) == NULL)            \
+            return false;                                                     \
                                                                               \
-                for (i = 0; i < nSubrects; i++) {                             \
-                    fgcolor = COLOR_FROM_PIXEL##bpp##_ADDRESS(ptr);           \
-					ptr += (bpp/8);                                           \
-                    sx = *ptr >> 4;                                           \
-                    sy = *ptr++ & 0x0f;                                       \
-                    sw = (*ptr >> 4) + 1;                                     \
-                    sh = (*ptr++ & 0x0f) + 1;                                 \
-                    FillSolidRect(x+sx, y+sy, sw, sh, fgcolor);               \
-                }                                                             \
+        omni_mutex_lock l(m_bitmapdcMutex);                                   \
+        FillSolidRect(x,y,w,h,m_hextileBg);                                   \
+        for (i = 0; i < nSubrects; i++) {                                     \
+            m_hextileFg = COLOR_FROM_PIXEL##bpp##_ADDRESS(ptr);               \
+            ptr += (bpp/8);                                                   \
+            sx = *ptr >> 4;                                                   \
+            sy = *ptr++ & 0x0f;                                               \
+            sw = (*ptr >> 4) + 1;                                             \
+            sh = (*ptr++ & 0x0f) + 1;                                         \
+            FillSolidRect(x+sx, y+sy, sw, sh, m_hextileFg);                   \
+        }                                                                     \
                                                                               \
-            } else {                                                          \
-                ReadExact(m_netbuf, nSubrects * 2);                    \
+    } else {                                                                  \
+        if ((ptr = src->Get(nSubrects * 2)) == NULL) return false;            \
                                                                               \
-                for (i = 0; i < nSubrects; i++) {                             \
-                    sx = *ptr >> 4;                                           \
-                    sy = *ptr++ & 0x0f;                                       \
-                    sw = (*ptr >> 4) + 1;                                     \
-                    sh = (*ptr++ & 0x0f) + 1;                                 \
-                    FillSolidRect(x+sx, y+sy, sw, sh, fgcolor);               \
-                }                                                             \
-            }                                                                 \
+        omni_mutex_lock l(m_bitmapdcMutex);                                   \
+        FillSolidRect(x,y,w,h,m_hextileBg);                                   \
+        for (i = 0; i < nSubrects; i++) {                                     \
+            sx = *ptr >> 4;                                                   \
+            sy = *ptr++ & 0x0f;                                               \
+            sw = (*ptr >> 4) + 1;                                             \
+            sh = (*ptr++ & 0x0f) + 1;                                         \
+            FillSolidRect(x+sx, y+sy, sw, sh, m_hextileFg);                   \
         }                                                                     \
     }                                                                         \
-                                                                              \
+    return true;                                                              \
 }
 
 DEFINE_HEXTILE(8)
@@ -17,8 +17,7 @@ void ClientConnection::ReadRRERect(rfbFramebufferUpdateRectHeader *pfburh)
 
 	prreh->nSubrects = Swap32IfLE(prreh->nSubrects);
 	
-	SETUP_COLOR_SHORTCUTS;
-    COLORREF color;
+    CARD32 color;
     switch (m_myFormat.bitsPerPixel) {
         case 8:
             color = COLOR_FROM_PIXEL8_ADDRESS(pcolor); break;
@@ -29,10 +28,11 @@ void ClientConnection::ReadRRERect(rfbFramebufferUpdateRectHeader *pfburh)
             color = COLOR_FROM_PIXEL32_ADDRESS(pcolor); break;
     }
 
-    // Draw the background of the rectangle
-    FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
-
-    if (prreh->nSubrects == 0) return;
+    if (prreh->nSubrects == 0) {
+		omni_mutex_lock l(m_bitmapdcMutex);
+		FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
+		return;
+	}
 
 	// Draw the sub-rectangles
     rfbRectangle rect, *pRect;
@@ -44,6 +44,13 @@ void ClientConnection::ReadRRERect(rfbFramebufferUpdateRectHeader *pfburh)
     ReadExact(m_netbuf, subRectSize * prreh->nSubrects);
 	BYTE *p = (BYTE *) m_netbuf;
 
+	// Only lock the framebuffer once we have all the data, so that
+	// painting isn't held up while we wait for the network.
+	omni_mutex_lock l(m_bitmapdcMutex);
+
+    // Draw the background of the rectangle
+    FillSolidRect(pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h, color);
+
     for (CARD32 i = 0; i < prreh->nSubrects; i++) {
         pRect = (rfbRectangle *) (p + m_minPixelBytes);
 
@@ -31,30 +31,46 @@
 
 void ClientConnection::ReadRawRect(rfbFramebufferUpdateRectHeader *pfburh) {
 
-	UINT numpixels = pfburh->r.w * pfburh->r.h;
-    // this assumes at least one byte per pixel. Naughty.
-	UINT numbytes = numpixels * m_minPixelBytes;
-	// Read in the whole thing
-    CheckBufferSize(numbytes);
-	ReadExact(m_netbuf, numbytes);
-
-	SETUP_COLOR_SHORTCUTS;
-
-	// This big switch is untidy but fast
 	switch (m_myFormat.bitsPerPixel) {
 	case 8:
-		SETPIXELS(8, pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h)
-		break;
 	case 16:
-		SETPIXELS(16, pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h)
-		break;
-	case 24:
 	case 32:
-		SETPIXELS(32, pfburh->r.x, pfburh->r.y, pfburh->r.w, pfburh->r.h)            
 		break;
 	default:
 		log.Print(0, _T("Invalid number of bits per pixel: %d\n"), m_myFormat.bitsPerPixel);
 		return;
 	}
-	
+
+	int x = pfburh->r.x, y = pfburh->r.y;
+	int w = pfburh->r.w, h = pfburh->r.h;
+	int rowbytes = w * m_minPixelBytes;
+	if (rowbytes == 0) return;
+
+	if (rowbytes <= INPUTBUFSIZE) {
+		// Convert as many rows as will fit in the input buffer at a time,
+		// straight from where they were received.  The framebuffer is 
+		// only locked while each band is drawn, not while we wait for it.
+		int rows = INPUTBUFSIZE / rowbytes;
+		while (h > 0) {
+			int n = min(rows, h);
+			char *src = ReadExactPtr(n * rowbytes);
+			{
+				omni_mutex_lock l(m_bitmapdcMutex);
+				SETPIXELS(src, x, y, w, n)
+			}
+			y += n;
+			h -= n;
+		}
+		return;
+	}
+
+	UINT numpixels = w * h;
+    // this assumes at least one byte per pixel. Naughty.
+	UINT numbytes = numpixels * m_minPixelBytes;
+	// Read in the whole thing
+    CheckBufferSize(numbytes);
+	ReadExact(m_netbuf, numbytes);
+
+	omni_mutex_lock l(m_bitmapdcMutex);
+	SETPIXELS(m_netbuf, x, y, w, h)
 }
@@ -0,0 +1,245 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// Statistics
+//
+// The bits of the ClientConnection object which gather up the counters
+// kept while the connection runs, for the connection info box and for
+// the statistics file.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+// The encodings we can decode, which each get their own columns
+static const int statsEncodings[] = {
+	rfbEncodingRaw, rfbEncodingCopyRect, rfbEncodingRRE, rfbEncodingCoRRE,
+	rfbEncodingHextile, rfbEncodingZlib, rfbEncodingTight, rfbEncodingZlibHex,
+	rfbEncodingTRLE, rfbEncodingZRLE
+};
+
+#define NSTATSENCODINGS (sizeof(statsEncodings) / sizeof(statsEncodings[0]))
+
+// Add to the string being built at p, with end just past the buffer.
+// Returns false, having cut the string short, if it doesn't fit.
+static bool Append(TCHAR *&p, TCHAR *end, const TCHAR *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	int n = _vsntprintf(p, end - p, format, ap);
+	va_end(ap);
+	if (n < 0 || n >= end - p) {
+		end[-1] = _T('\0');
+		p = end - 1;
+		return false;
+	}
+	p += n;
+	return true;
+}
+
+// The host name as it goes in the file: with quotes and backslashes
+// escaped for JSON, or for CSV in quotes, with quotes doubled.  out must
+// have room for twice the name and three more characters.
+static void QuoteHost(TCHAR *out, const TCHAR *host, bool json)
+{
+	if (!json) *out++ = _T('"');
+	for (; *host; host++) {
+		if (*host == _T('"'))
+			*out++ = json ? _T('\\') : _T('"');
+		else if (*host == _T('\\') && json)
+			*out++ = _T('\\');
+		*out++ = *host;
+	}
+	if (!json) *out++ = _T('"');
+	*out = _T('\0');
+}
+
+// Called by the worker thread when an update arrives.  If we were waiting
+// for the answer to a request, note how long it took.
+
+void ClientConnection::UpdateRequestAnswered()
+{
+	omni_mutex_lock l(m_writeMutex);
+	if (!m_requestOutstanding) return;
+	m_requestOutstanding = false;
+	m_requestRTT = GetTickCount() - m_requestTime;
+	m_requestRTTTotal += m_requestRTT;
+	m_requestRTTs++;
+}
+
+// A summary for the connection info box, in a buffer of len characters
+
+void ClientConnection::FormatStats(TCHAR *buf, int len)
+{
+	if (len <= 0) return;
+	DWORD secs = m_connectTime == 0 ? 0 : (GetTickCount() - m_connectTime) / 1000;
+	TCHAR *p = buf, *end = buf + len;
+	bool room = Append(p, end, 
+		_T("Received %lu bytes in %lu recv calls\n\r")
+		_T("Sent %lu bytes in %lu send calls\n\r")
+		_T("Updates: %lu, %lu per minute\n\r")
+		_T("Update requests answered in %lu ms on average\n\r")
+		_T("Fences answered in %lu ms\n\r")
+		_T("Painting: %lu ms in %lu paints\n\r"),
+		m_bytesRead, m_recvCalls, m_bytesWritten, m_sendCalls,
+		m_updatesReceived, m_updatesReceived * 60 / max(secs, 1),
+		m_requestRTTTotal / max(m_requestRTTs, 1), m_fenceRTT,
+		m_paintTime, m_paints);
+	for (int i = 0; room && i < NSTATSENCODINGS; i++) {
+		int enc = statsEncodings[i];
+		if (m_encRects[enc] == 0) continue;
+		room = Append(p, end, _T("Encoding %d: %lu rects, %lu ms decoding\n\r"),
+			enc, m_encRects[enc], m_encTime[enc]);
+	}
+}
+
+// If asked to, a line of statistics is added to a file every 
+// STATSINTERVAL ms, so that many viewers can be watched at once.  It is
+// JSON, one object per line, if the file's name ends in .json, and 
+// otherwise comma-separated values with a heading line at the top.
+
+void ClientConnection::OpenStatsFile()
+{
+	m_statsFile = CreateFile(m_opts.m_statsFilename, GENERIC_WRITE, 
+		FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_statsFile == INVALID_HANDLE_VALUE) {
+		log.Print(0, _T("Error opening statistics file %s\n"), m_opts.m_statsFilename);
+		return;
+	}
+	SetFilePointer(m_statsFile, 0, NULL, FILE_END);
+
+	int len = _tcslen(m_opts.m_statsFilename);
+	m_statsJSON = (len >= 5 && 
+		_tcsicmp(m_opts.m_statsFilename + len - 5, _T(".json")) == 0);
+	m_lastStatsTime = GetTickCount();
+	m_lastStatsUpdates = m_updatesReceived;
+
+	if (m_statsJSON || GetFileSize(m_statsFile, NULL) != 0)
+		return;
+	TCHAR line[STATSLINESIZE];
+	TCHAR *p = line, *end = line + STATSLINESIZE;
+	bool room = Append(p, end, _T("time,host,port,seconds,bytes_in,bytes_out,updates,")
+		_T("updates_per_sec,recv_calls,send_calls,paints,paint_ms,")
+		_T("request_rtt_ms,fence_rtt_ms"));
+	for (int i = 0; room && i < NSTATSENCODINGS; i++) {
+		int enc = statsEncodings[i];
+		room = Append(p, end, _T(",enc%d_rects,enc%d_bytes,enc%d_ms"), enc, enc, enc);
+	}
+	if (room && Append(p, end, _T("\r\n")))
+		WriteStatsLine(line);
+}
+
+// Called by the main thread on a timer, and when the connection closes
+
+void ClientConnection::WriteStats()
+{
+	if (m_statsFile == INVALID_HANDLE_VALUE) return;
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	DWORD now = GetTickCount();
+	DWORD secs = m_connectTime == 0 ? 0 : (now - m_connectTime) / 1000;
+	DWORD updates = m_updatesReceived;
+	DWORD rate = (updates - m_lastStatsUpdates) * 1000 / max(now - m_lastStatsTime, 1);
+	m_lastStatsTime = now;
+	m_lastStatsUpdates = updates;
+	DWORD requestRTT = m_requestRTTTotal / max(m_requestRTTs, 1);
+
+	TCHAR host[2 * sizeof(m_host) / sizeof(TCHAR) + 3];
+	QuoteHost(host, m_host, m_statsJSON);
+
+	TCHAR line[STATSLINESIZE];
+	TCHAR *p = line, *end = line + STATSLINESIZE;
+	bool room;
+	if (m_statsJSON) {
+		room = Append(p, end, 
+			_T("{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d\",\"host\":\"%s\",\"port\":%d,")
+			_T("\"seconds\":%lu,\"bytesIn\":%lu,\"bytesOut\":%lu,\"updates\":%lu,")
+			_T("\"updatesPerSec\":%lu,\"recvCalls\":%lu,\"sendCalls\":%lu,")
+			_T("\"paints\":%lu,\"paintMs\":%lu,\"requestRttMs\":%lu,\"fenceRttMs\":%lu,")
+			_T("\"encodings\":["),
+			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+			host, m_port, secs, m_bytesRead, m_bytesWritten, updates, rate,
+			m_recvCalls, m_sendCalls, m_paints, m_paintTime, requestRTT, m_fenceRTT);
+		for (int i = 0; room && i < NSTATSENCODINGS; i++) {
+			int enc = statsEncodings[i];
+			room = Append(p, end, _T("%s{\"encoding\":%d,\"rects\":%lu,\"bytes\":%lu,\"ms\":%lu}"),
+				i == 0 ? _T("") : _T(","), 
+				enc, m_encRects[enc], m_encBytes[enc], m_encTime[enc]);
+		}
+		room = room && Append(p, end, _T("]}\r\n"));
+	} else {
+		room = Append(p, end, 
+			_T("%04d-%02d-%02d %02d:%02d:%02d,%s,%d,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu"),
+			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+			host, m_port, secs, m_bytesRead, m_bytesWritten, updates, rate,
+			m_recvCalls, m_sendCalls, m_paints, m_paintTime, requestRTT, m_fenceRTT);
+		for (int i = 0; room && i < NSTATSENCODINGS; i++) {
+			int enc = statsEncodings[i];
+			room = Append(p, end, _T(",%lu,%lu,%lu"), 
+				m_encRects[enc], m_encBytes[enc], m_encTime[enc]);
+		}
+		room = room && Append(p, end, _T("\r\n"));
+	}
+
+	// A line cut short would spoil the file for whatever reads it
+	if (room)
+		WriteStatsLine(line);
+	else
+		log.Print(1, _T("Statistics line too long to write\n"));
+}
+
+// The file is more use to other programs if it isn't unicode.  If it 
+// can't be written, say so once and stop trying.
+
+void ClientConnection::WriteStatsLine(TCHAR *line)
+{
+	DWORD written;
+#ifdef UNICODE
+	char ansiline[STATSLINESIZE];
+	int len = WideCharToMultiByte(CP_ACP, 0, line, _tcslen(line), 
+		ansiline, STATSLINESIZE, NULL, NULL);
+	BOOL ok = WriteFile(m_statsFile, ansiline, len, &written, NULL);
+#else
+	int len = _tcslen(line);
+	BOOL ok = WriteFile(m_statsFile, line, len, &written, NULL);
+#endif
+	if (!ok || written != (DWORD) len) {
+		log.Print(0, _T("Error %d writing statistics file %s, no more will be written\n"),
+			GetLastError(), m_opts.m_statsFilename);
+		CloseHandle(m_statsFile);
+		m_statsFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+void ClientConnection::CloseStatsFile()
+{
+	if (m_statsFile == INVALID_HANDLE_VALUE) return;
+	WriteStats();
+	if (m_statsFile == INVALID_HANDLE_VALUE) return;
+	CloseHandle(m_statsFile);
+	m_statsFile = INVALID_HANDLE_VALUE;
+}
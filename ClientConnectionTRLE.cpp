@@ -0,0 +1,57 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// TRLE Encoding
+//
+// The bits of the ClientConnection object to do with TRLE.  The tiles are
+// ZRLE's, so the same decoder is used, reading straight from the socket.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+void ClientConnection::ReadTRLERect(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	int rx = pfburh->r.x, ry = pfburh->r.y;
+	int rw = pfburh->r.w, rh = pfburh->r.h;
+
+	for (int y = ry; y < ry+rh; y += rfbTRLETileHeight) {
+		int h = min(rfbTRLETileHeight, ry+rh - y);
+		for (int x = rx; x < rx+rw; x += rfbTRLETileWidth) {
+			int w = min(rfbTRLETileWidth, rx+rw - x);
+
+			// Decode the tile without the framebuffer locked, since
+			// we may have to wait for its data, then copy it in.
+			if (!m_trleDecoder.DecodeTile(&m_socketSource, 0, 0, w, h)) {
+				log.Print(0, _T("Invalid TRLE data in tile at %d,%d\n"), x, y);
+				RaiseException(VNC_EXC_INVALID,0,0,0);
+			}
+
+			omni_mutex_lock l(m_bitmapdcMutex);
+			for (int j = 0; j < h; j++)
+				memcpy(m_fb.Row(y + j) + x, m_trleTile.Row(j), w * sizeof(CARD32));
+		}
+	}
+}
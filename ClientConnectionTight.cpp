@@ -0,0 +1,353 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// Tight Encoding
+//
+// The bits of the ClientConnection object to do with Tight.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+#include <stdio.h>
+#include <setjmp.h>
+extern "C" {
+#include "jpeglib.h"
+}
+
+void ClientConnection::ReadTightRect(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	int x = pfburh->r.x, y = pfburh->r.y;
+	int w = pfburh->r.w, h = pfburh->r.h;
+	int tpixel = m_tightCutZeros ? 3 : m_conv.m_bytesPerPixel;
+
+	CARD8 comp_ctl;
+	ReadExact((char *) &comp_ctl, 1);
+
+	// The server may have started some of its streams again
+	for (int i = 0; i < 4; i++) {
+		if (comp_ctl & (1 << i))
+			m_tightStreams[i].Reset();
+	}
+	comp_ctl >>= 4;
+
+	if (comp_ctl == rfbTightFill) {
+		CARD8 pix[4];
+		ReadExact((char *) pix, tpixel);
+		omni_mutex_lock l(m_bitmapdcMutex);
+		FillSolidRect(x, y, w, h, TightPixelAt(pix));
+		return;
+	}
+
+	if (comp_ctl == rfbTightJpeg) {
+		int len = ReadCompactLen();
+		CheckBufferSize(len);
+		ReadExact(m_netbuf, len);
+		if (!DecodeTightJpeg((CARD8 *) m_netbuf, len, x, y, w, h)) {
+			log.Print(0, _T("Invalid Tight JPEG data\n"));
+			RaiseException(VNC_EXC_INVALID,0,0,0);
+		}
+		return;
+	}
+
+	if (comp_ctl > rfbTightMaxSubencoding || w > rfbTightMaxRectWidth) {
+		log.Print(0, _T("Invalid Tight rectangle, type %d, width %d\n"), comp_ctl, w);
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+
+	// Basic compression, with a filter
+	int filter = rfbTightFilterCopy;
+	int numColors = 0;
+	int rowbytes = w * tpixel;
+	if (comp_ctl & rfbTightExplicitFilter) {
+		CARD8 id;
+		ReadExact((char *) &id, 1);
+		filter = id;
+
+		switch (filter) {
+		case rfbTightFilterCopy:
+		case rfbTightFilterGradient:
+			break;
+		case rfbTightFilterPalette:
+			{
+				CARD8 n;
+				ReadExact((char *) &n, 1);
+				numColors = n + 1;
+				CARD8 *p = (CARD8 *) ReadExactPtr(numColors * tpixel);
+				for (int i = 0; i < numColors; i++) {
+					m_tightPalette[i] = TightPixelAt(p);
+					p += tpixel;
+				}
+				rowbytes = (numColors == 2) ? (w + 7) / 8 : w;
+				break;
+			}
+		default:
+			log.Print(0, _T("Unknown Tight filter %d\n"), filter);
+			RaiseException(VNC_EXC_INVALID,0,0,0);
+		}
+	}
+
+	// Small amounts of data aren't compressed
+	int size = rowbytes * h;
+	if (size < rfbTightMinToCompress) {
+		CARD8 buf[rfbTightMinToCompress];
+		ReadExact((char *) buf, size);
+		MemoryByteSource src(buf, size);
+		DecodeTightRows(&src, filter, numColors, x, y, w, h);
+		return;
+	}
+
+	int len = ReadCompactLen();
+	CheckBufferSize(len);
+	ReadExact(m_netbuf, len);
+
+	ZlibInStream *zs = &m_tightStreams[comp_ctl & 0x03];
+	zs->SetInput((CARD8 *) m_netbuf, len);
+	DecodeTightRows(zs, filter, numColors, x, y, w, h);
+	if (!zs->FinishInput()) {
+		log.Print(0, _T("Invalid Tight zlib data\n"));
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+}
+
+// Lengths of compressed data are sent in 1 to 3 bytes
+int ClientConnection::ReadCompactLen()
+{
+	CARD8 b;
+	ReadExact((char *) &b, 1);
+	int len = b & 0x7f;
+	if (b & 0x80) {
+		ReadExact((char *) &b, 1);
+		len |= (b & 0x7f) << 7;
+		if (b & 0x80) {
+			ReadExact((char *) &b, 1);
+			len |= b << 14;
+		}
+	}
+	return len;
+}
+
+// Take the filtered data a row at a time and draw it.  The framebuffer
+// is locked for each row, so painting can carry on in between.
+void ClientConnection::DecodeTightRows(ByteSource *src, int filter, int numColors, 
+									   int x, int y, int w, int h)
+{
+	int tpixel = m_tightCutZeros ? 3 : m_conv.m_bytesPerPixel;
+	int rowbytes = w * tpixel;
+	if (filter == rfbTightFilterPalette)
+		rowbytes = (numColors == 2) ? (w + 7) / 8 : w;
+	if (filter == rfbTightFilterGradient)
+		memset(m_tightPrevRow, 0, w * 3 * sizeof(CARD16));
+
+	for (int j = 0; j < h; j++) {
+		const CARD8 *p = src->Get(rowbytes);
+		if (p == NULL) {
+			log.Print(0, _T("Tight data ended early\n"));
+			RaiseException(VNC_EXC_INVALID,0,0,0);
+		}
+
+		omni_mutex_lock l(m_bitmapdcMutex);
+		CARD32 *dst = m_fb.Row(y + j) + x;
+		int i;
+
+		switch (filter) {
+		case rfbTightFilterCopy:
+			if (m_tightCutZeros) {
+				for (i = 0; i < w; i++, p += 3)
+					dst[i] = PIXEL_RGB(p[0], p[1], p[2]);
+			} else {
+				m_conv.ConvertRow(p, dst, w);
+			}
+			break;
+		case rfbTightFilterPalette:
+			if (numColors == 2) {
+				for (i = 0; i < w; i++)
+					dst[i] = m_tightPalette[(p[i >> 3] >> (7 - (i & 7))) & 1];
+			} else {
+				for (i = 0; i < w; i++)
+					dst[i] = m_tightPalette[p[i]];
+			}
+			break;
+		case rfbTightFilterGradient:
+			TightGradientRow(p, dst, w);
+			break;
+		}
+	}
+}
+
+// Each colour component is sent as the difference from a prediction
+// made from the pixels to the left, above and above left.
+void ClientConnection::TightGradientRow(const CARD8 *src, CARD32 *dst, int w)
+{
+	int max[3], shift[3];
+	if (m_tightCutZeros) {
+		max[0] = max[1] = max[2] = 0xff;
+		shift[0] = shift[1] = shift[2] = 0;
+	} else {
+		max[0] = m_myFormat.redMax;   shift[0] = m_myFormat.redShift;
+		max[1] = m_myFormat.greenMax; shift[1] = m_myFormat.greenShift;
+		max[2] = m_myFormat.blueMax;  shift[2] = m_myFormat.blueShift;
+	}
+	int bpp = m_conv.m_bytesPerPixel;
+
+	int left[3] = { 0, 0, 0 }, upleft[3] = { 0, 0, 0 };
+	CARD16 *prev = m_tightPrevRow;
+
+	for (int i = 0; i < w; i++) {
+		int diff[3], c;
+		if (m_tightCutZeros) {
+			diff[0] = src[0];
+			diff[1] = src[1];
+			diff[2] = src[2];
+			src += 3;
+		} else {
+			CARD32 v = src[0];
+			if (bpp > 1) v |= src[1] << 8;
+			if (bpp > 2) v |= (src[2] << 16) | ((CARD32) src[3] << 24);
+			for (c = 0; c < 3; c++)
+				diff[c] = (v >> shift[c]) & max[c];
+			src += bpp;
+		}
+
+		for (c = 0; c < 3; c++) {
+			int up = prev[c];
+			int est = left[c] + up - upleft[c];
+			if (est < 0) est = 0;
+			if (est > max[c]) est = max[c];
+			left[c] = (est + diff[c]) & max[c];
+			upleft[c] = up;
+			prev[c] = left[c];
+		}
+		prev += 3;
+
+		if (m_tightCutZeros)
+			dst[i] = PIXEL_RGB(left[0], left[1], left[2]);
+		else
+			dst[i] = m_conv.Pixel32((left[0] << shift[0]) | 
+				(left[1] << shift[1]) | (left[2] << shift[2]));
+	}
+}
+
+// JPEG rectangles are decoded with the IJG library, straight from the
+// data we've read.  Its fatal errors would normally exit, so we jump
+// back to DecodeTightJpeg instead.
+
+struct TightJpegError {
+	struct jpeg_error_mgr pub;
+	jmp_buf jmp;
+};
+
+static void JpegErrorExit(j_common_ptr cinfo)
+{
+	longjmp(((TightJpegError *) cinfo->err)->jmp, 1);
+}
+
+static void JpegOutputMessage(j_common_ptr cinfo)
+{
+}
+
+static void JpegInitSource(j_decompress_ptr cinfo)
+{
+}
+
+// All the data is there to start with, so if libjpeg wants more it's 
+// truncated.  Give it an end marker, and it will finish with a warning.
+static boolean JpegFillInputBuffer(j_decompress_ptr cinfo)
+{
+	static const JOCTET eoi[2] = { 0xff, JPEG_EOI };
+	cinfo->src->next_input_byte = eoi;
+	cinfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
+
+static void JpegSkipInputData(j_decompress_ptr cinfo, long n)
+{
+	if (n <= 0) return;
+	if ((size_t) n > cinfo->src->bytes_in_buffer)
+		n = cinfo->src->bytes_in_buffer;
+	cinfo->src->next_input_byte += n;
+	cinfo->src->bytes_in_buffer -= n;
+}
+
+static void JpegTermSource(j_decompress_ptr cinfo)
+{
+}
+
+// Returns false if the data is bad.  No objects with destructors may be
+// used in here, because of the longjmp.
+bool ClientConnection::DecodeTightJpeg(const CARD8 *data, int len, 
+									   int x, int y, int w, int h)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_source_mgr src;
+	TightJpegError jerr;
+
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = JpegErrorExit;
+	jerr.pub.output_message = JpegOutputMessage;
+	if (setjmp(jerr.jmp)) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+	jpeg_create_decompress(&cinfo);
+
+	src.init_source = JpegInitSource;
+	src.fill_input_buffer = JpegFillInputBuffer;
+	src.skip_input_data = JpegSkipInputData;
+	src.resync_to_restart = jpeg_resync_to_restart;
+	src.term_source = JpegTermSource;
+	src.next_input_byte = data;
+	src.bytes_in_buffer = len;
+	cinfo.src = &src;
+
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+
+	if ((int) cinfo.output_width != w || (int) cinfo.output_height != h ||
+		cinfo.output_components != 3) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	JSAMPARRAY row = (*cinfo.mem->alloc_sarray)
+		((j_common_ptr) &cinfo, JPOOL_IMAGE, w * 3, 1);
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		int j = cinfo.output_scanline;
+		jpeg_read_scanlines(&cinfo, row, 1);
+
+		m_bitmapdcMutex.lock();
+		CARD32 *dst = m_fb.Row(y + j) + x;
+		JSAMPLE *p = row[0];
+		for (int i = 0; i < w; i++, p += 3)
+			dst[i] = PIXEL_RGB(p[0], p[1], p[2]);
+		m_bitmapdcMutex.unlock();
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return true;
+}
@@ -0,0 +1,71 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// ZRLE Encoding
+//
+// The bits of the ClientConnection object to do with ZRLE.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+void ClientConnection::ReadZRLERect(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	rfbZRLEHeader hdr;
+	ReadExact((char *) &hdr, sz_rfbZRLEHeader);
+	hdr.length = Swap32IfLE(hdr.length);
+
+	// Read all the compressed data, then decompress it a tile at a time
+	// as we draw, so we never need room for the whole rectangle.
+	CheckBufferSize(hdr.length);
+	ReadExact(m_netbuf, hdr.length);
+	m_zrleStream.SetInput((CARD8 *) m_netbuf, hdr.length);
+
+	int rx = pfburh->r.x, ry = pfburh->r.y;
+	int rw = pfburh->r.w, rh = pfburh->r.h;
+
+	for (int y = ry; y < ry+rh; y += rfbZRLETileHeight) {
+		int h = min(rfbZRLETileHeight, ry+rh - y);
+		for (int x = rx; x < rx+rw; x += rfbZRLETileWidth) {
+			int w = min(rfbZRLETileWidth, rx+rw - x);
+
+			bool ok;
+			{
+				omni_mutex_lock l(m_bitmapdcMutex);
+				ok = m_rleDecoder.DecodeTile(&m_zrleStream, x, y, w, h);
+			}
+			if (!ok) {
+				log.Print(0, _T("Invalid ZRLE data in tile at %d,%d\n"), x, y);
+				RaiseException(VNC_EXC_INVALID,0,0,0);
+			}
+		}
+	}
+
+	// The next rectangle's data carries on from the end of this one's
+	if (!m_zrleStream.FinishInput()) {
+		log.Print(0, _T("Invalid ZRLE data\n"));
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+}
@@ -0,0 +1,83 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// Zlib Encoding
+//
+// The bits of the ClientConnection object to do with Zlib.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+void ClientConnection::ReadZlibRect(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	rfbZlibHeader hdr;
+	ReadExact((char *) &hdr, sz_rfbZlibHeader);
+	hdr.nBytes = Swap32IfLE(hdr.nBytes);
+
+	CheckBufferSize(hdr.nBytes);
+	ReadExact(m_netbuf, hdr.nBytes);
+	m_zlibStream.SetInput((CARD8 *) m_netbuf, hdr.nBytes);
+
+	int x = pfburh->r.x, y = pfburh->r.y;
+	int w = pfburh->r.w, h = pfburh->r.h;
+	int bpp = m_conv.m_bytesPerPixel;
+
+	// An empty rectangle has nothing to draw, but any data sent with it
+	// is still part of the stream.
+	if (w == 0 || h == 0) {
+		if (!m_zlibStream.FinishInput()) {
+			log.Print(0, _T("Invalid Zlib data\n"));
+			RaiseException(VNC_EXC_INVALID,0,0,0);
+		}
+		return;
+	}
+
+	// Inflate as many rows as the stream's buffer holds at a time and 
+	// convert them as Raw does.  Rows too wide for it go in pieces.
+	int pw = min(w, ZLIBOUTBUFSIZE / bpp);
+	int rows = (pw == w) ? ZLIBOUTBUFSIZE / (w * bpp) : 1;
+
+	while (h > 0) {
+		int n = min(rows, h);
+		for (int px = x; px < x+w; px += pw) {
+			int cw = min(pw, x+w - px);
+			const CARD8 *src = m_zlibStream.Get(n * cw * bpp);
+			if (src == NULL) {
+				log.Print(0, _T("Zlib data ended early\n"));
+				RaiseException(VNC_EXC_INVALID,0,0,0);
+			}
+			omni_mutex_lock l(m_bitmapdcMutex);
+			SETPIXELS(src, px, y, cw, n)
+		}
+		y += n;
+		h -= n;
+	}
+
+	if (!m_zlibStream.FinishInput()) {
+		log.Print(0, _T("Invalid Zlib data\n"));
+		RaiseException(VNC_EXC_INVALID,0,0,0);
+	}
+}
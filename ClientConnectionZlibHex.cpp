@@ -0,0 +1,95 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// ZlibHex Encoding
+//
+// The bits of the ClientConnection object to do with ZlibHex.  Tiles are
+// decoded by the Hextile code, reading from the socket or from one of 
+// the zlib streams as each tile says.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "ClientConnection.h"
+#include "Exception.h"
+
+void ClientConnection::ReadZlibHexRect(rfbFramebufferUpdateRectHeader *pfburh)
+{
+	switch (m_myFormat.bitsPerPixel) {
+	case 8:
+	case 16:
+	case 32:
+		break;
+	default:
+		log.Print(0, _T("Invalid number of bits per pixel: %d\n"), m_myFormat.bitsPerPixel);
+		return;
+	}
+
+	int rx = pfburh->r.x, ry = pfburh->r.y;
+	int rw = pfburh->r.w, rh = pfburh->r.h;
+
+	for (int y = ry; y < ry+rh; y += 16) {
+		int h = min(16, ry+rh - y);
+		for (int x = rx; x < rx+rw; x += 16) {
+			int w = min(16, rx+rw - x);
+
+			CARD8 subencoding;
+			ReadExact((char *) &subencoding, 1);
+
+			if (!(subencoding & (rfbHextileZlibRaw | rfbHextileZlibHex))) {
+				HandleHextileTile(&m_socketSource, subencoding, x, y, w, h);
+				continue;
+			}
+
+			// The compressed data is used where it lies in the input 
+			// buffer if it fits, so nothing is copied on the way.
+			CARD16 len;
+			ReadExact((char *) &len, 2);
+			len = Swap16IfLE(len);
+			CARD8 *data;
+			if (len <= INPUTBUFSIZE) {
+				data = (CARD8 *) ReadExactPtr(len);
+			} else {
+				CheckBufferSize(len);
+				ReadExact(m_netbuf, len);
+				data = (CARD8 *) m_netbuf;
+			}
+
+			ZlibInStream *zs;
+			bool ok;
+			if (subencoding & rfbHextileZlibRaw) {
+				zs = &m_zlibHexRawStream;
+				zs->SetInput(data, len);
+				ok = HandleHextileTile(zs, rfbHextileRaw, x, y, w, h);
+			} else {
+				zs = &m_zlibHexEncStream;
+				zs->SetInput(data, len);
+				ok = HandleHextileTile(zs, subencoding, x, y, w, h);
+			}
+			if (!ok || !zs->FinishInput()) {
+				log.Print(0, _T("Invalid ZlibHex data in tile at %d,%d\n"), x, y);
+				RaiseException(VNC_EXC_INVALID,0,0,0);
+			}
+		}
+	}
+}
@@ -0,0 +1,132 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// DamageRegion.cpp
+// Merging of changed rectangles.
+
+#include "DamageRegion.h"
+
+static inline int Area(const DamageRect &r)
+{
+	return (r.right - r.left) * (r.bottom - r.top);
+}
+
+static inline DamageRect Union(const DamageRect &a, const DamageRect &b)
+{
+	DamageRect u;
+	u.left   = a.left   < b.left   ? a.left   : b.left;
+	u.top    = a.top    < b.top    ? a.top    : b.top;
+	u.right  = a.right  > b.right  ? a.right  : b.right;
+	u.bottom = a.bottom > b.bottom ? a.bottom : b.bottom;
+	return u;
+}
+
+static inline bool Overlaps(const DamageRect &a, const DamageRect &b)
+{
+	return a.left < b.right && b.left < a.right &&
+		a.top < b.bottom && b.top < a.bottom;
+}
+
+// The number of pixels covered by the union of a and b which aren't in
+// either of them, given that they don't overlap.
+static inline int Waste(const DamageRect &a, const DamageRect &b)
+{
+	return Area(Union(a, b)) - Area(a) - Area(b);
+}
+
+DamageRegion::DamageRegion()
+{
+	Clear();
+}
+
+void DamageRegion::Clear()
+{
+	m_count = 0;
+	m_added = 0;
+}
+
+void DamageRegion::Add(int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0) return;
+
+	DamageRect r;
+	r.left = x;
+	r.top = y;
+	r.right = x + w;
+	r.bottom = y + h;
+	m_added++;
+	Insert(r);
+}
+
+void DamageRegion::Add(const DamageRegion &other)
+{
+	for (int i = 0; i < other.m_count; i++)
+		Insert(other.m_rects[i]);
+	m_added += other.m_added;
+}
+
+// The rectangles are kept disjoint, so anything the new one overlaps is
+// merged with it.  Neighbours are merged too if that adds few pixels,
+// which catches rows and columns of tiles.  Merging can make the new
+// rectangle overlap others, so we go round again until nothing changes.
+
+void DamageRegion::Insert(DamageRect r)
+{
+	bool merged;
+	do {
+		merged = false;
+		for (int i = 0; i < m_count; i++) {
+			if (Overlaps(r, m_rects[i]) ||
+				Waste(r, m_rects[i]) <= (Area(r) + Area(m_rects[i])) / 4) {
+				r = Union(r, m_rects[i]);
+				Remove(i);
+				merged = true;
+				break;
+			}
+		}
+
+		// If there's no room, merge with whichever wastes least
+		if (!merged && m_count == MAXDAMAGERECTS) {
+			int best = 0;
+			int bestWaste = Waste(r, m_rects[0]);
+			for (int i = 1; i < m_count; i++) {
+				int waste = Waste(r, m_rects[i]);
+				if (waste < bestWaste) {
+					best = i;
+					bestWaste = waste;
+				}
+			}
+			r = Union(r, m_rects[best]);
+			Remove(best);
+			merged = true;
+		}
+	} while (merged);
+
+	m_rects[m_count++] = r;
+}
+
+void DamageRegion::Remove(int i)
+{
+	m_rects[i] = m_rects[--m_count];
+}
@@ -0,0 +1,64 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// DamageRegion.h
+// Collects the rectangles changed by a screen update and merges them into
+// a small set of disjoint rectangles, so that the window can be 
+// invalidated a few times rather than once per rectangle.  Like 
+// PixelBuffer, nothing in here depends on Windows.
+
+#pragma once
+
+// The most rectangles a region will hold.  Beyond this, the rectangles
+// which waste the fewest pixels by being combined are merged.
+#define MAXDAMAGERECTS 16
+
+struct DamageRect {
+	int left, top, right, bottom;
+};
+
+class DamageRegion
+{
+public:
+	DamageRegion();
+
+	void Clear();
+	void Add(int x, int y, int w, int h);
+	void Add(const DamageRegion &other);
+
+	inline bool IsEmpty() const { return m_count == 0; };
+	inline int Count() const { return m_count; };
+	inline const DamageRect &Rect(int i) const { return m_rects[i]; };
+
+	// How many rectangles have been added since the last Clear.  Compare
+	// with Count() for the merge ratio.
+	unsigned long m_added;
+
+private:
+	void Insert(DamageRect r);
+	void Remove(int i);
+
+	DamageRect m_rects[MAXDAMAGERECTS];
+	int m_count;
+};
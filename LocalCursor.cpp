@@ -0,0 +1,116 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// LocalCursor.cpp
+// Drawing the remote cursor locally.
+
+#include <string.h>
+#include "LocalCursor.h"
+
+LocalCursor::LocalCursor()
+{
+	m_width = m_height = 0;
+	m_hotX = m_hotY = 0;
+	m_pixels = NULL;
+	m_mask = NULL;
+	m_saved = NULL;
+	m_drawn = false;
+}
+
+LocalCursor::~LocalCursor()
+{
+	delete [] m_pixels;
+	delete [] m_mask;
+	delete [] m_saved;
+}
+
+bool LocalCursor::SetShape(int w, int h, int hotx, int hoty)
+{
+	delete [] m_pixels;
+	delete [] m_mask;
+	delete [] m_saved;
+	m_pixels = NULL;
+	m_mask = NULL;
+	m_saved = NULL;
+	m_width = m_height = 0;
+	m_drawn = false;
+
+	if (w > MAXCURSORSIZE || h > MAXCURSORSIZE) return false;
+	if (w <= 0 || h <= 0) return true;
+
+	m_width = w;
+	m_height = h;
+	m_hotX = hotx;
+	m_hotY = hoty;
+	m_pixels = new CARD32[w * h];
+	m_saved = new CARD32[w * h];
+	m_mask = new CARD8[MaskRowBytes() * h];
+	return true;
+}
+
+void LocalCursor::GetRect(int x, int y, int &left, int &top, int &right, int &bottom) const
+{
+	left = x - m_hotX;
+	top = y - m_hotY;
+	right = left + m_width;
+	bottom = top + m_height;
+}
+
+void LocalCursor::Draw(PixelBuffer *fb, int x, int y)
+{
+	if (!IsVisible() || m_drawn) return;
+
+	int left = x - m_hotX, top = y - m_hotY;
+	int cx = left, cy = top, cw = m_width, ch = m_height;
+	if (!fb->ClipRect(cx, cy, cw, ch)) return;
+
+	int maskbytes = MaskRowBytes();
+	for (int j = 0; j < ch; j++) {
+		CARD32 *dst = fb->Row(cy + j) + cx;
+		memcpy(m_saved + j * cw, dst, cw * sizeof(CARD32));
+
+		int sy = cy + j - top;
+		const CARD32 *src = m_pixels + sy * m_width;
+		const CARD8 *mask = m_mask + sy * maskbytes;
+		for (int i = 0; i < cw; i++) {
+			int sx = cx + i - left;
+			if (mask[sx >> 3] & (0x80 >> (sx & 7)))
+				dst[i] = src[sx];
+		}
+	}
+
+	m_savedX = cx;
+	m_savedY = cy;
+	m_savedW = cw;
+	m_savedH = ch;
+	m_drawn = true;
+}
+
+void LocalCursor::Undraw(PixelBuffer *fb)
+{
+	if (!m_drawn) return;
+	for (int j = 0; j < m_savedH; j++)
+		memcpy(fb->Row(m_savedY + j) + m_savedX, m_saved + j * m_savedW, m_savedW * sizeof(CARD32));
+	m_drawn = false;
+}
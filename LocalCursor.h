@@ -0,0 +1,77 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// LocalCursor.h
+// The shape of the remote cursor, as sent by the server, so that we can
+// draw it ourselves wherever the local pointer is rather than have the
+// server draw it into the framebuffer.  Like PixelBuffer, nothing in here
+// depends on Windows.
+
+#pragma once
+
+#include "rfb.h"
+#include "PixelBuffer.h"
+
+// Bigger cursors than this are ignored
+#define MAXCURSORSIZE 128
+
+class LocalCursor
+{
+public:
+	LocalCursor();
+	~LocalCursor();
+
+	// Make room for a new shape, whose pixels and mask are then filled in.
+	// A size of 0x0 means the cursor is hidden.  Returns false, and hides
+	// the cursor, if it is too big.
+	bool SetShape(int w, int h, int hotx, int hoty);
+
+	// Framebuffer pixels, a row at a time
+	inline CARD32 *Pixels() { return m_pixels; };
+	// One bit per pixel, most significant bit first, with each row 
+	// starting on a byte boundary.  Pixels whose bits are clear aren't drawn.
+	inline CARD8 *Mask() { return m_mask; };
+	inline int MaskRowBytes() const { return (m_width + 7) / 8; };
+
+	inline bool IsVisible() const { return m_width > 0 && m_height > 0; };
+
+	// The area the cursor covers when its hotspot is at (x,y)
+	void GetRect(int x, int y, int &left, int &top, int &right, int &bottom) const;
+
+	// Draw the cursor into fb with its hotspot at (x,y), keeping what was 
+	// underneath, and put it back again.  Draws must be undrawn before 
+	// the next.
+	void Draw(PixelBuffer *fb, int x, int y);
+	void Undraw(PixelBuffer *fb);
+
+	int m_width, m_height;
+	int m_hotX, m_hotY;
+
+private:
+	CARD32 *m_pixels;
+	CARD8 *m_mask;
+	CARD32 *m_saved;
+	int m_savedX, m_savedY, m_savedW, m_savedH;
+	bool m_drawn;
+};
@@ -0,0 +1,101 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// PixelBuffer.cpp
+// Drawing primitives for the local framebuffer memory.
+
+#include <string.h>
+#include "PixelBuffer.h"
+
+PixelBuffer::PixelBuffer()
+{
+	Detach();
+}
+
+void PixelBuffer::Attach(void *bits, int width, int height, int stride)
+{
+	m_bits = (CARD8 *) bits;
+	m_width = width;
+	m_height = height;
+	m_stride = stride;
+}
+
+void PixelBuffer::Detach()
+{
+	m_bits = NULL;
+	m_width = m_height = m_stride = 0;
+}
+
+bool PixelBuffer::ClipRect(int &x, int &y, int &w, int &h)
+{
+	if (x < 0) { w += x; x = 0; }
+	if (y < 0) { h += y; y = 0; }
+	if (x + w > m_width)  w = m_width - x;
+	if (y + h > m_height) h = m_height - y;
+	return (w > 0) && (h > 0) && (m_bits != NULL);
+}
+
+void PixelBuffer::FillRect(int x, int y, int w, int h, CARD32 pix)
+{
+	if (!ClipRect(x, y, w, h)) return;
+
+	CARD32 *row = Row(y) + x;
+	int i;
+
+	// Fill the first row a pixel at a time, then copy it down.
+	for (i = 0; i < w; i++)
+		row[i] = pix;
+
+	CARD32 *dst = row;
+	for (i = 1; i < h; i++) {
+		dst = (CARD32 *) ((CARD8 *) dst + m_stride);
+		memcpy(dst, row, w * sizeof(CARD32));
+	}
+}
+
+// The source and destination may overlap, so we go down the rows
+// or up them depending on which way things are moving.
+void PixelBuffer::CopyRect(int x, int y, int w, int h, int srcx, int srcy)
+{
+	// Clip the destination, then shift the source by the same amount
+	int ox = x, oy = y;
+	if (!ClipRect(x, y, w, h)) return;
+	srcx += x - ox;
+	srcy += y - oy;
+
+	// ...and clip again so the source lies within the buffer too
+	ox = srcx; oy = srcy;
+	if (!ClipRect(srcx, srcy, w, h)) return;
+	x += srcx - ox;
+	y += srcy - oy;
+
+	int bytes = w * sizeof(CARD32);
+	if (srcy >= y) {
+		for (int i = 0; i < h; i++)
+			memmove(Row(y + i) + x, Row(srcy + i) + srcx, bytes);
+	} else {
+		for (int i = h - 1; i >= 0; i--)
+			memmove(Row(y + i) + x, Row(srcy + i) + srcx, bytes);
+	}
+}
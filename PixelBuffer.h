@@ -0,0 +1,68 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// PixelBuffer.h
+// A directly addressable block of 32-bit pixels, used to hold the local
+// copy of the remote screen.  Each pixel is stored as 0x00RRGGBB, which is
+// what a 32-bit BI_RGB DIB section expects.  Nothing in here depends on
+// Windows, so it can be built and exercised on other platforms.
+
+#pragma once
+
+#include <stddef.h>
+#include "rfb.h"
+
+// Pack 8-bit colour components into a framebuffer pixel.
+#define PIXEL_RGB(r,g,b) ((CARD32) (((r) << 16) | ((g) << 8) | (b)))
+
+class PixelBuffer
+{
+public:
+	PixelBuffer();
+
+	// Point the buffer at memory owned by somebody else (eg the bits
+	// of a DIB section).  Stride is in bytes.
+	void Attach(void *bits, int width, int height, int stride);
+	void Detach();
+	inline bool IsValid() { return m_bits != NULL; };
+
+	// Address of the first pixel of row y.  No checking is done.
+	inline CARD32 *Row(int y) { 
+		return (CARD32 *) (m_bits + y * m_stride); 
+	};
+
+	// Trim a rectangle to the buffer.  Returns false if nothing is left.
+	bool ClipRect(int &x, int &y, int &w, int &h);
+
+	// These clip to the buffer, so bad subrectangles from the server
+	// can't write outside it.
+	void FillRect(int x, int y, int w, int h, CARD32 pix);
+	void CopyRect(int x, int y, int w, int h, int srcx, int srcy);
+
+	int m_width, m_height;
+	int m_stride;
+
+private:
+	CARD8 *m_bits;
+};
@@ -0,0 +1,285 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// PixelConverter.cpp
+// Table-driven conversion of server pixels to framebuffer pixels.
+
+#include <string.h>
+#include "PixelConverter.h"
+
+PixelConverter::PixelConverter()
+{
+	m_red = m_green = m_blue = NULL;
+	m_bytesPerPixel = 1;
+	m_cpixelBytes = 1;
+	m_cpixelShift = 0;
+	m_rs = m_gs = m_bs = 0;
+	m_rm = m_gm = m_bm = 0;
+	memset(m_table8, 0, sizeof(m_table8));
+	m_convertRow = &PixelConverter::ConvertRow8;
+}
+
+PixelConverter::~PixelConverter()
+{
+	FreeTables();
+}
+
+void PixelConverter::FreeTables()
+{
+	delete [] m_red;
+	delete [] m_green;
+	delete [] m_blue;
+	m_red = m_green = m_blue = NULL;
+}
+
+// Build a table mapping every value from 0 to max onto an 8-bit
+// component shifted left by outshift.  This is the only place we divide.
+CARD32 *PixelConverter::MakeChannelTable(CARD16 max, int outshift)
+{
+	CARD32 *table = new CARD32[max + 1];
+	if (max == 0) {
+		table[0] = 0;
+		return table;
+	}
+	for (CARD32 i = 0; i <= max; i++)
+		table[i] = (i * 255 / max) << outshift;
+	return table;
+}
+
+void PixelConverter::SetFormat(const rfbPixelFormat &pf, bool specialised)
+{
+	FreeTables();
+
+	m_rs = pf.redShift;   m_rm = pf.redMax;
+	m_gs = pf.greenShift; m_gm = pf.greenMax;
+	m_bs = pf.blueShift;  m_bm = pf.blueMax;
+
+	m_red   = MakeChannelTable(m_rm, 16);
+	m_green = MakeChannelTable(m_gm, 8);
+	m_blue  = MakeChannelTable(m_bm, 0);
+
+	for (int i = 0; i < 256; i++)
+		m_table8[i] = Pixel32(i);
+
+	switch (pf.bitsPerPixel) {
+	case 8:
+		m_bytesPerPixel = 1;
+		break;
+	case 16:
+		m_bytesPerPixel = 2;
+		break;
+	default:
+		m_bytesPerPixel = 4;
+		break;
+	}
+	m_convertRow = specialised ? ChooseRowConverter(pf) : GenericRowConverter(pf);
+
+	// Work out whether a 32-bit pixel will fit in its low or high 3 bytes
+	CARD32 used = ((CARD32) m_rm << m_rs) | ((CARD32) m_gm << m_gs) | ((CARD32) m_bm << m_bs);
+	m_cpixelBytes = m_bytesPerPixel;
+	m_cpixelShift = 0;
+	if (pf.bitsPerPixel == 32 && pf.depth <= 24 && pf.trueColour) {
+		if ((used & 0xff000000) == 0) {
+			m_cpixelBytes = 3;
+		} else if ((used & 0x000000ff) == 0) {
+			m_cpixelBytes = 3;
+			m_cpixelShift = 8;
+		}
+	}
+}
+
+void PixelConverter::ConvertCPixelRow(const CARD8 *src, CARD32 *dst, int n)
+{
+	if (m_cpixelBytes == m_bytesPerPixel) {
+		ConvertRow(src, dst, n);
+		return;
+	}
+	while (n-- > 0) {
+		*dst++ = CPixelAt(src);
+		src += 3;
+	}
+}
+
+#define FORMAT_IS(pf, bpp, rm, gm, bm, rs, gs, bs)				\
+	((pf).bitsPerPixel == (bpp) &&								\
+	 (pf).redMax == (rm) && (pf).greenMax == (gm) && (pf).blueMax == (bm) && \
+	 (pf).redShift == (rs) && (pf).greenShift == (gs) && (pf).blueShift == (bs))
+
+// Pick the quickest row converter that handles the given format.
+PixelConverter::RowConverter PixelConverter::ChooseRowConverter(const rfbPixelFormat &pf)
+{
+	if (FORMAT_IS(pf, 32, 255, 255, 255, 16, 8, 0))
+		return &PixelConverter::ConvertRow32RGB888;
+	if (FORMAT_IS(pf, 32, 255, 255, 255, 0, 8, 16))
+		return &PixelConverter::ConvertRow32BGR888;
+	if (FORMAT_IS(pf, 16, 31, 63, 31, 11, 5, 0))
+		return &PixelConverter::ConvertRow16RGB565;
+	if (FORMAT_IS(pf, 16, 31, 31, 31, 10, 5, 0))
+		return &PixelConverter::ConvertRow16RGB555;
+	// This is vnc16bitFormat, which we ask for from palette-based servers
+	if (FORMAT_IS(pf, 16, 63, 31, 31, 0, 6, 11))
+		return &PixelConverter::ConvertRow16BGR556;
+	return GenericRowConverter(pf);
+}
+
+// The converters which work for any layout of the given size
+PixelConverter::RowConverter PixelConverter::GenericRowConverter(const rfbPixelFormat &pf)
+{
+	switch (pf.bitsPerPixel) {
+	case 8:
+		return &PixelConverter::ConvertRow8;
+	case 16:
+		return &PixelConverter::ConvertRow16;
+	default:
+		return &PixelConverter::ConvertRow32;
+	}
+}
+
+void PixelConverter::ConvertRow8(const CARD8 *src, CARD32 *dst, int n)
+{
+	const CARD32 *t = m_table8;
+	while (n >= 4) {
+		dst[0] = t[src[0]];
+		dst[1] = t[src[1]];
+		dst[2] = t[src[2]];
+		dst[3] = t[src[3]];
+		src += 4; dst += 4; n -= 4;
+	}
+	while (n-- > 0)
+		*dst++ = t[*src++];
+}
+
+void PixelConverter::ConvertRow16(const CARD8 *src, CARD32 *dst, int n)
+{
+	while (n-- > 0) {
+		*dst++ = Pixel16((CARD16) (src[0] | (src[1] << 8)));
+		src += 2;
+	}
+}
+
+void PixelConverter::ConvertRow32(const CARD8 *src, CARD32 *dst, int n)
+{
+	while (n-- > 0) {
+		*dst++ = Pixel32(src[0] | (src[1] << 8) | (src[2] << 16) | ((CARD32) src[3] << 24));
+		src += 4;
+	}
+}
+
+// The specialised converters.
+// There's no SIMD on the processors we run on, so these rely on fixed 
+// shifts and masks, unrolling, and reading two or more pixels with each 
+// word load when the source happens to be aligned.  CARD32 is exactly 32
+// bits wherever we're built, so each load takes two 16-bit pixels or one
+// 32-bit one.  The loads go through memcpy, which compilers turn into a
+// single load, since reading the bytes through a CARD32 pointer breaks 
+// the aliasing rules.  They use the same tables as everything else, so 
+// the colours come out identical.
+
+#define WORD_ALIGNED(p) ((((unsigned long) (p)) & 3) == 0)
+
+#ifdef LITTLE_ENDIAN_HOST
+
+#define DEFINE_ROW16(name, rs, gs, bs, rm, gm, bm)								\
+void PixelConverter::name(const CARD8 *src, CARD32 *dst, int n)				\
+{																				\
+	const CARD32 *r = m_red, *g = m_green, *b = m_blue;							\
+	CARD32 p;																	\
+	if (WORD_ALIGNED(src)) {													\
+		while (n >= 2) {														\
+			CARD32 w;															\
+			memcpy(&w, src, 4);													\
+			p = w & 0xffff;														\
+			dst[0] = r[(p >> rs) & rm] | g[(p >> gs) & gm] | b[(p >> bs) & bm];	\
+			p = w >> 16;														\
+			dst[1] = r[(p >> rs) & rm] | g[(p >> gs) & gm] | b[(p >> bs) & bm];	\
+			src += 4; dst += 2; n -= 2;											\
+		}																		\
+	}																			\
+	while (n-- > 0) {															\
+		p = src[0] | (src[1] << 8);												\
+		*dst++ = r[(p >> rs) & rm] | g[(p >> gs) & gm] | b[(p >> bs) & bm];		\
+		src += 2;																\
+	}																			\
+}
+
+#else
+
+#define DEFINE_ROW16(name, rs, gs, bs, rm, gm, bm)								\
+void PixelConverter::name(const CARD8 *src, CARD32 *dst, int n)				\
+{																				\
+	const CARD32 *r = m_red, *g = m_green, *b = m_blue;							\
+	CARD32 p;																	\
+	while (n-- > 0) {															\
+		p = src[0] | (src[1] << 8);												\
+		*dst++ = r[(p >> rs) & rm] | g[(p >> gs) & gm] | b[(p >> bs) & bm];		\
+		src += 2;																\
+	}																			\
+}
+
+#endif
+
+DEFINE_ROW16(ConvertRow16RGB565, 11, 5, 0, 31, 63, 31)
+DEFINE_ROW16(ConvertRow16RGB555, 10, 5, 0, 31, 31, 31)
+DEFINE_ROW16(ConvertRow16BGR556, 0, 6, 11, 63, 31, 31)
+
+// With 8-bit channels in the same places as ours, the tables are the
+// identity, so we just have to clear the top byte.
+void PixelConverter::ConvertRow32RGB888(const CARD8 *src, CARD32 *dst, int n)
+{
+#ifdef LITTLE_ENDIAN_HOST
+	if (WORD_ALIGNED(src)) {
+		CARD32 w[4];
+		while (n >= 4) {
+			memcpy(w, src, 16);
+			dst[0] = w[0] & 0x00ffffff;
+			dst[1] = w[1] & 0x00ffffff;
+			dst[2] = w[2] & 0x00ffffff;
+			dst[3] = w[3] & 0x00ffffff;
+			src += 16; dst += 4; n -= 4;
+		}
+		while (n-- > 0) {
+			memcpy(w, src, 4);
+			*dst++ = w[0] & 0x00ffffff;
+			src += 4;
+		}
+		return;
+	}
+#endif
+	while (n-- > 0) {
+		*dst++ = src[0] | (src[1] << 8) | (src[2] << 16);
+		src += 4;
+	}
+}
+
+// The same, but with red and blue swapped over.
+void PixelConverter::ConvertRow32BGR888(const CARD8 *src, CARD32 *dst, int n)
+{
+	while (n >= 2) {
+		dst[0] = src[2] | (src[1] << 8) | (src[0] << 16);
+		dst[1] = src[6] | (src[5] << 8) | (src[4] << 16);
+		src += 8; dst += 2; n -= 2;
+	}
+	if (n > 0)
+		*dst = src[2] | (src[1] << 8) | (src[0] << 16);
+}
@@ -0,0 +1,127 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// PixelConverter.h
+// Turns pixels in the format we've asked the server for into the
+// 0x00RRGGBB values held in a PixelBuffer.  Lookup tables are built
+// whenever the format is set, so that converting a pixel costs a few
+// shifts, masks and loads but no multiplies or divides.
+//
+// Pixels on the wire are always little-endian, because that's what 
+// SetFormatAndEncodings asks for.  They are read a byte at a time, so
+// the source needn't be aligned.
+
+#pragma once
+
+#include "rfb.h"
+
+class PixelConverter
+{
+public:
+	PixelConverter();
+	virtual ~PixelConverter();
+
+	// Rebuild the tables for a new pixel format.  The fixed-layout row
+	// converters are used where they fit unless specialised is false, 
+	// which the tests use to compare them with the general ones.
+	void SetFormat(const rfbPixelFormat &pf, bool specialised = true);
+
+	// Convert single pixel values of the appropriate size
+	inline CARD32 Pixel8(CARD8 p) { 
+		return m_table8[p]; 
+	};
+	inline CARD32 Pixel16(CARD16 p) {
+		return m_red[(p >> m_rs) & m_rm] | 
+			m_green[(p >> m_gs) & m_gm] | 
+			m_blue[(p >> m_bs) & m_bm];
+	};
+	inline CARD32 Pixel32(CARD32 p) {
+		return m_red[(p >> m_rs) & m_rm] | 
+			m_green[(p >> m_gs) & m_gm] | 
+			m_blue[(p >> m_bs) & m_bm];
+	};
+
+	// Convert the pixel stored at the given address
+	inline CARD32 PixelAt(const CARD8 *p) {
+		switch (m_bytesPerPixel) {
+		case 1:
+			return Pixel8(p[0]);
+		case 2:
+			return Pixel16((CARD16) (p[0] | (p[1] << 8)));
+		default:
+			return Pixel32(p[0] | (p[1] << 8) | (p[2] << 16) | ((CARD32) p[3] << 24));
+		}
+	};
+
+	// Convert n consecutive pixels from src into dst.
+	inline void ConvertRow(const CARD8 *src, CARD32 *dst, int n) {
+		(this->*m_convertRow)(src, dst, n);
+	};
+
+	// ZRLE and TRLE send 32-bit pixels as 3 bytes if the top or bottom 
+	// byte is never used.  These convert such "compressed pixels".
+	inline CARD32 CPixelAt(const CARD8 *p) {
+		if (m_cpixelBytes != 3) return PixelAt(p);
+		return Pixel32((p[0] | (p[1] << 8) | ((CARD32) p[2] << 16)) << m_cpixelShift);
+	};
+	void ConvertCPixelRow(const CARD8 *src, CARD32 *dst, int n);
+
+	// The size of one source pixel
+	int m_bytesPerPixel;
+	// The size of one compressed pixel
+	int m_cpixelBytes;
+
+private:
+	typedef void (PixelConverter::*RowConverter)(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow8(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow16(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow32(const CARD8 *src, CARD32 *dst, int n);
+
+	// Faster versions for the layouts we see most often, with the 
+	// shifts and masks fixed at compile time.
+	void ConvertRow16RGB565(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow16RGB555(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow16BGR556(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow32RGB888(const CARD8 *src, CARD32 *dst, int n);
+	void ConvertRow32BGR888(const CARD8 *src, CARD32 *dst, int n);
+	RowConverter ChooseRowConverter(const rfbPixelFormat &pf);
+	RowConverter GenericRowConverter(const rfbPixelFormat &pf);
+	RowConverter m_convertRow;
+
+	void FreeTables();
+	CARD32 *MakeChannelTable(CARD16 max, int outshift);
+
+	CARD8 m_rs, m_gs, m_bs;
+	CARD16 m_rm, m_gm, m_bm;
+	// Where the 3 bytes of a compressed pixel go in a 32-bit one
+	int m_cpixelShift;
+
+	// One table per channel, indexed by the channel value and holding
+	// it scaled to 8 bits and shifted into place.  A complete table for
+	// 16-bit pixels would need 256K, which is a lot on a small device.
+	CARD32 *m_red, *m_green, *m_blue;
+
+	// 8-bit pixels are looked up in one go.
+	CARD32 m_table8[256];
+};
@@ -0,0 +1,193 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// RLETileDecoder.cpp
+// ZRLE and TRLE tile decoding.
+
+#include <string.h>
+#include "RLETileDecoder.h"
+
+RLETileDecoder::RLETileDecoder()
+{
+	m_fb = NULL;
+	m_conv = NULL;
+	m_paletteSize = 0;
+	m_reusePalette = false;
+	for (int i = 0; i < 128; i++)
+		m_palette[i] = 0;
+}
+
+void RLETileDecoder::Attach(PixelBuffer *fb, PixelConverter *conv, bool reusePalette)
+{
+	m_fb = fb;
+	m_conv = conv;
+	m_reusePalette = reusePalette;
+}
+
+bool RLETileDecoder::DecodeTile(ByteSource *src, int x, int y, int w, int h)
+{
+	const CARD8 *p = src->Get(1);
+	if (p == NULL) return false;
+	int subencoding = *p;
+	int bpp = m_conv->m_cpixelBytes;
+
+	if (subencoding == 0) {
+		// Raw pixels
+		int rowbytes = w * bpp;
+		if ((p = src->Get(rowbytes * h)) == NULL) return false;
+		for (int j = 0; j < h; j++) {
+			m_conv->ConvertCPixelRow(p, m_fb->Row(y + j) + x, w);
+			p += rowbytes;
+		}
+		return true;
+	}
+
+	if (subencoding == 1) {
+		// A solid colour
+		if ((p = src->Get(bpp)) == NULL) return false;
+		m_fb->FillRect(x, y, w, h, m_conv->CPixelAt(p));
+		return true;
+	}
+
+	if (subencoding <= 16) {
+		if (!ReadPalette(src, subencoding)) return false;
+		return DecodePacked(src, x, y, w, h);
+	}
+
+	if (subencoding == 128)
+		return DecodeRuns(src, x, y, w, h, false);
+
+	if (subencoding >= 130) {
+		if (!ReadPalette(src, subencoding - 128)) return false;
+		return DecodeRuns(src, x, y, w, h, true);
+	}
+
+	// TRLE can use the last palette again, packed or run-length encoded
+	if (m_reusePalette && m_paletteSize > 0) {
+		if (subencoding == 127)
+			return DecodePacked(src, x, y, w, h);
+		if (subencoding == 129)
+			return DecodeRuns(src, x, y, w, h, true);
+	}
+
+	// 17 to 126 aren't used, nor are 127 and 129 in ZRLE
+	return false;
+}
+
+bool RLETileDecoder::ReadPalette(ByteSource *src, int n)
+{
+	int bpp = m_conv->m_cpixelBytes;
+	const CARD8 *p = src->Get(n * bpp);
+	if (p == NULL) return false;
+	for (int i = 0; i < n; i++) {
+		m_palette[i] = m_conv->CPixelAt(p);
+		p += bpp;
+	}
+	m_paletteSize = n;
+	return true;
+}
+
+// Palette indices of 1, 2 or 4 bits, packed most significant bits first,
+// with each row starting on a byte boundary.  With a palette of 3, 5 or
+// more colours an index can be past the end of it.
+bool RLETileDecoder::DecodePacked(ByteSource *src, int x, int y, int w, int h)
+{
+	int bits = (m_paletteSize == 2) ? 1 : (m_paletteSize <= 4) ? 2 : 4;
+	int mask = (1 << bits) - 1;
+	int rowbytes = (w * bits + 7) / 8;
+
+	const CARD8 *p = src->Get(rowbytes * h);
+	if (p == NULL) return false;
+
+	for (int j = 0; j < h; j++) {
+		CARD32 *dst = m_fb->Row(y + j) + x;
+		const CARD8 *q = p;
+		int shift = 8;
+		for (int i = 0; i < w; i++) {
+			shift -= bits;
+			int index = (*q >> shift) & mask;
+			if (index >= m_paletteSize) return false;
+			dst[i] = m_palette[index];
+			if (shift == 0) {
+				shift = 8;
+				q++;
+			}
+		}
+		p += rowbytes;
+	}
+	return true;
+}
+
+// Runs of one colour, which carry on from one row to the next.  Each run
+// is a pixel or palette index followed by its length less one, given as
+// a series of bytes which are added up, all but the last being 255.  With
+// a palette, runs of length one are sent as just the index, and the top
+// bit of the index says whether a length follows.
+bool RLETileDecoder::DecodeRuns(ByteSource *src, int x, int y, int w, int h, bool usePalette)
+{
+	int bpp = m_conv->m_cpixelBytes;
+	int row = 0, col = 0;
+	const CARD8 *p;
+
+	while (row < h) {
+		CARD32 color;
+		int len = 1;
+		bool isRun = true;
+
+		if (usePalette) {
+			if ((p = src->Get(1)) == NULL) return false;
+			int index = *p & 0x7f;
+			if (index >= m_paletteSize) return false;
+			color = m_palette[index];
+			isRun = (*p & 0x80) != 0;
+		} else {
+			if ((p = src->Get(bpp)) == NULL) return false;
+			color = m_conv->CPixelAt(p);
+		}
+
+		if (isRun) {
+			do {
+				if ((p = src->Get(1)) == NULL) return false;
+				len += *p;
+			} while (*p == 255);
+		}
+
+		// Draw the run, a row at a time
+		while (len > 0) {
+			if (row == h) return false;
+			int n = w - col;
+			if (n > len) n = len;
+			CARD32 *dst = m_fb->Row(y + row) + x + col;
+			for (int i = 0; i < n; i++)
+				dst[i] = color;
+			len -= n;
+			col += n;
+			if (col == w) {
+				col = 0;
+				row++;
+			}
+		}
+	}
+	return true;
+}
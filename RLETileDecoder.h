@@ -0,0 +1,63 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// RLETileDecoder.h
+// Decodes the tiles of ZRLE and TRLE rectangles into a PixelBuffer.  Each
+// tile is raw, a solid colour, a packed palette, or run-length encoded with
+// or without a palette.  TRLE tiles may also reuse the previous tile's
+// palette.  Nothing in here depends on Windows.
+
+#pragma once
+
+#include "rfb.h"
+#include "ByteSource.h"
+#include "PixelBuffer.h"
+#include "PixelConverter.h"
+
+class RLETileDecoder
+{
+public:
+	RLETileDecoder();
+
+	// Where the pixels go, and how to convert them, and whether tiles may
+	// reuse the last palette, as TRLE's can.
+	void Attach(PixelBuffer *fb, PixelConverter *conv, bool reusePalette = false);
+
+	// Decode one tile from src into the framebuffer at (x,y).  Returns 
+	// false if the data is bad, in which case the tile may be part drawn.
+	// The tile must lie within the framebuffer.
+	bool DecodeTile(ByteSource *src, int x, int y, int w, int h);
+
+private:
+	bool ReadPalette(ByteSource *src, int n);
+	bool DecodePacked(ByteSource *src, int x, int y, int w, int h);
+	bool DecodeRuns(ByteSource *src, int x, int y, int w, int h, bool usePalette);
+
+	PixelBuffer *m_fb;
+	PixelConverter *m_conv;
+
+	CARD32 m_palette[128];
+	int m_paletteSize;
+	bool m_reusePalette;
+};
@@ -0,0 +1,197 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// SessionRecorder.cpp
+//
+// An FBS file starts with "FBS 001.000\n" and is followed by blocks of 
+// data received from the server.  Each block is a 4-byte length, the 
+// data padded to a multiple of 4 bytes, and a 4-byte time in ms since the
+// recording started, all numbers being big-endian.
+
+#include "stdhdrs.h"
+#include "vncviewer.h"
+#include "SessionRecorder.h"
+
+SessionRecorder::SessionRecorder()
+{
+	m_file = INVALID_HANDLE_VALUE;
+	m_dataEvent = NULL;
+	m_writer = NULL;
+	m_buf = NULL;
+	m_head = m_tail = 0;
+	m_stopping = m_failed = false;
+	m_bytesRecorded = m_blocksRecorded = 0;
+	m_startTime = 0;
+}
+
+SessionRecorder::~SessionRecorder()
+{
+	Close();
+}
+
+bool SessionRecorder::Open(LPCTSTR filename)
+{
+	m_file = CreateFile(filename, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		log.Print(0, _T("Error creating recording file %s\n"), filename);
+		return false;
+	}
+	m_buf = new char[RECORDBUFSIZE];
+	m_dataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_startTime = GetTickCount();
+
+	Put("FBS 001.000\n", 12);
+	m_writer = omni_thread::create(WriterThread, this, omni_thread::PRIORITY_LOW);
+	log.Print(1, _T("Recording to %s\n"), filename);
+	return true;
+}
+
+// Add to the buffer, which must have room.  Only the reading thread 
+// moves m_head, so the copy needn't hold the lock.
+
+void SessionRecorder::Put(const char *buf, int len)
+{
+	int head = m_head;
+	int n = min(len, RECORDBUFSIZE - head);
+	memcpy(m_buf + head, buf, n);
+	memcpy(m_buf, buf + n, len - n);
+	head = (head + len) % RECORDBUFSIZE;
+
+	omni_mutex_lock l(m_mutex);
+	m_head = head;
+}
+
+void SessionRecorder::PutCARD32(CARD32 n)
+{
+	char b[4];
+	b[0] = (char) (n >> 24);
+	b[1] = (char) (n >> 16);
+	b[2] = (char) (n >> 8);
+	b[3] = (char) n;
+	Put(b, 4);
+}
+
+void SessionRecorder::Record(const char *buf, int len)
+{
+	if (!IsRecording()) return;
+	DWORD now = GetTickCount() - m_startTime;
+	static const char zeros[4] = {0, 0, 0, 0};
+
+	while (len > 0) {
+		int n = min(len, RECORDBLOCKSIZE);
+		int padded = (n + 3) & ~3;
+		{
+			// One byte is always left free, so that a full buffer 
+			// doesn't look empty.
+			omni_mutex_lock l(m_mutex);
+			int used = (m_head - m_tail + RECORDBUFSIZE) % RECORDBUFSIZE;
+			if (m_failed) return;
+			if (RECORDBUFSIZE - 1 - used < padded + 8) {
+				log.Print(0, _T("Recording stopped because the file can't keep up\n"));
+				m_failed = true;
+				return;
+			}
+		}
+		PutCARD32(n);
+		Put(buf, n);
+		Put(zeros, padded - n);
+		PutCARD32(now);
+		SetEvent(m_dataEvent);
+
+		m_bytesRecorded += n;
+		m_blocksRecorded++;
+		buf += n;
+		len -= n;
+	}
+}
+
+// Write out whatever is in the buffer.  The writer thread doesn't hold 
+// the lock while writing, so the reading thread can carry on adding.
+
+bool SessionRecorder::Drain()
+{
+	while (true) {
+		int head, tail;
+		{
+			omni_mutex_lock l(m_mutex);
+			head = m_head;
+			tail = m_tail;
+		}
+		if (head == tail) return true;
+
+		int n = (head > tail) ? head - tail : RECORDBUFSIZE - tail;
+		DWORD written;
+		if (!WriteFile(m_file, m_buf + tail, n, &written, NULL) || 
+			written != (DWORD) n) {
+			log.Print(0, _T("Recording stopped by error %d writing the file\n"),
+				GetLastError());
+			omni_mutex_lock l(m_mutex);
+			m_failed = true;
+			return false;
+		}
+
+		omni_mutex_lock l(m_mutex);
+		m_tail = (tail + n) % RECORDBUFSIZE;
+	}
+}
+
+void *SessionRecorder::WriterThread(void *arg)
+{
+	SessionRecorder *_this = (SessionRecorder *) arg;
+
+	while (true) {
+		WaitForSingleObject(_this->m_dataEvent, INFINITE);
+		if (!_this->Drain()) 
+			break;
+		omni_mutex_lock l(_this->m_mutex);
+		if (_this->m_stopping && _this->m_head == _this->m_tail)
+			break;
+	}
+	return NULL;
+}
+
+void SessionRecorder::Close()
+{
+	if (m_file == INVALID_HANDLE_VALUE) return;
+
+	if (m_writer != NULL) {
+		{
+			omni_mutex_lock l(m_mutex);
+			m_stopping = true;
+		}
+		SetEvent(m_dataEvent);
+		m_writer->join(NULL);
+		m_writer = NULL;
+	}
+	log.Print(1, _T("Recorded %lu bytes in %lu blocks\n"), 
+		m_bytesRecorded, m_blocksRecorded);
+
+	CloseHandle(m_dataEvent);
+	m_dataEvent = NULL;
+	CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	delete [] m_buf;
+	m_buf = NULL;
+}
@@ -0,0 +1,82 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// SessionRecorder.h
+// Keeps a copy of everything received from the server, with the time
+// each piece arrived, in the FBS format used by session players.  The 
+// data is gathered in a fixed-size buffer and written out by a thread of
+// its own, so recording costs the reading thread only a copy.
+
+#pragma once
+
+#include "stdhdrs.h"
+#ifdef UNDER_CE
+#include "omnithreadce.h"
+#else
+#include "omnithread.h"
+#endif
+#include "rfb.h"
+
+// The most memory used to hold data waiting to be written.  If the file
+// can't keep up and this fills, recording stops.
+#define RECORDBUFSIZE 262144
+// Bigger pieces of data are split into blocks of this size
+#define RECORDBLOCKSIZE 8192
+
+class SessionRecorder
+{
+public:
+	SessionRecorder();
+	~SessionRecorder();
+
+	// Start a new file.  Returns false if it can't be created.
+	bool Open(LPCTSTR filename);
+	// Called by the thread reading from the server for each piece of
+	// data as it arrives
+	void Record(const char *buf, int len);
+	// Write out anything still waiting and close the file
+	void Close();
+
+	inline bool IsRecording() const { return m_file != INVALID_HANDLE_VALUE && !m_failed; };
+
+	DWORD m_bytesRecorded, m_blocksRecorded;
+
+private:
+	static void *WriterThread(void *arg);
+	bool Drain();
+	void Put(const char *buf, int len);
+	void PutCARD32(CARD32 n);
+
+	HANDLE m_file;
+	// Set when there is data for the writer to write
+	HANDLE m_dataEvent;
+	omni_thread *m_writer;
+	DWORD m_startTime;
+	// Data is added at m_head by the reading thread and written from 
+	// m_tail by the writer.  m_mutex protects these and the flags.
+	char *m_buf;
+	int m_head, m_tail;
+	bool m_stopping, m_failed;
+	omni_mutex m_mutex;
+};
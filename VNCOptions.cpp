@@ -31,16 +31,37 @@
 
 VNCOptions::VNCOptions()
 {
+	// Encoding numbers have gaps, so only allow the ones we can decode
 	for (int i = rfbEncodingRaw; i<= LASTENCODING; i++)
-		m_UseEnc[i] = true;
+		m_UseEnc[i] = false;
+	m_UseEnc[rfbEncodingRaw] = true;
+	m_UseEnc[rfbEncodingCopyRect] = true;
+	m_UseEnc[rfbEncodingRRE] = true;
+	m_UseEnc[rfbEncodingCoRRE] = true;
+	m_UseEnc[rfbEncodingHextile] = true;
+	m_UseEnc[rfbEncodingZlib] = true;
+	m_UseEnc[rfbEncodingZlibHex] = true;
+	m_UseEnc[rfbEncodingTight] = true;
+	m_UseEnc[rfbEncodingTRLE] = true;
+	m_UseEnc[rfbEncodingZRLE] = true;
 	
 	m_ViewOnly = false;
 	m_Use8Bit = false;
-	m_PreferredEncoding = rfbEncodingHextile;
+	m_PreferredEncoding = rfbEncodingZRLE;
 	m_SwapMouse = false;
 	m_Emul3Buttons = false;  // not implemented yet
 	m_Shared = false;
 	m_DeiconifyOnBell = false;
+	m_PointerInterval = 40;
+	m_ViewportUpdates = true;
+	m_BackgroundInterval = 5000;
+	m_PipelineUpdates = true;
+	m_CompressLevel = 6;
+	m_QualityLevel = 6;
+	m_LocalCursor = true;
+	m_ContinuousUpdates = true;
+	m_AutoSelect = true;
+	m_AutoDepth = true;
 	m_host[0] = '\0';
 	m_port = -1;
 	
@@ -50,6 +71,10 @@ VNCOptions::VNCOptions()
 	m_logLevel = 0;
 	m_logToConsole = false;
 	m_logToFile = false;
+	m_statsToFile = false;
+	m_statsFilename[0] = '\0';
+	m_recordToFile = false;
+	m_recordFilename[0] = '\0';
 	
 	m_delay=0;
 	m_connectionSpecified = false;
@@ -125,6 +150,64 @@ void VNCOptions::SetFromCommandLine(LPTSTR szCmdLine) {
 			m_SwapMouse = true;
 		} else if ( SwitchMatch(args[j], _T("belldeiconify") )) {
 			m_DeiconifyOnBell = true;
+		} else if ( SwitchMatch(args[j], _T("pointerinterval") )) {
+			if (++j == i) {
+				ArgError(_T("No pointer interval specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%d"), &m_PointerInterval) != 1 ||
+				m_PointerInterval < 0) {
+				ArgError(_T("Invalid pointer interval specified"));
+				m_PointerInterval = 40;
+				continue;
+			}
+		} else if ( SwitchMatch(args[j], _T("fullupdates") )) {
+			m_ViewportUpdates = false;
+		} else if ( SwitchMatch(args[j], _T("nopipeline") )) {
+			m_PipelineUpdates = false;
+		} else if ( SwitchMatch(args[j], _T("nocontinuous") )) {
+			m_ContinuousUpdates = false;
+		} else if ( SwitchMatch(args[j], _T("noautoselect") )) {
+			m_AutoSelect = false;
+		} else if ( SwitchMatch(args[j], _T("noautodepth") )) {
+			m_AutoDepth = false;
+		} else if ( SwitchMatch(args[j], _T("nolocalcursor") )) {
+			m_LocalCursor = false;
+		} else if ( SwitchMatch(args[j], _T("nojpeg") )) {
+			m_QualityLevel = -1;
+		} else if ( SwitchMatch(args[j], _T("compresslevel") )) {
+			if (++j == i) {
+				ArgError(_T("No compression level specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%d"), &m_CompressLevel) != 1 ||
+				m_CompressLevel < -1 || m_CompressLevel > 9) {
+				ArgError(_T("Invalid compression level specified"));
+				m_CompressLevel = 6;
+				continue;
+			}
+		} else if ( SwitchMatch(args[j], _T("quality") )) {
+			if (++j == i) {
+				ArgError(_T("No quality level specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%d"), &m_QualityLevel) != 1 ||
+				m_QualityLevel < -1 || m_QualityLevel > 9) {
+				ArgError(_T("Invalid quality level specified"));
+				m_QualityLevel = 6;
+				continue;
+			}
+		} else if ( SwitchMatch(args[j], _T("backgroundinterval") )) {
+			if (++j == i) {
+				ArgError(_T("No background interval specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%d"), &m_BackgroundInterval) != 1 ||
+				m_BackgroundInterval < 0) {
+				ArgError(_T("Invalid background interval specified"));
+				m_BackgroundInterval = 5000;
+				continue;
+			}
 		} else if ( SwitchMatch(args[j], _T("delay") )) {
 			if (++j == i) {
 				ArgError(_T("No delay specified"));
@@ -158,6 +241,28 @@ void VNCOptions::SetFromCommandLine(LPTSTR szCmdLine) {
 			} else {
 				m_logToFile = true;
 			}
+		} else if ( SwitchMatch(args[j], _T("statsfile") )) {
+			if (++j == i) {
+				ArgError(_T("No statistics file specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%s"), &m_statsFilename) != 1) {
+				ArgError(_T("Invalid statistics file specified"));
+				continue;
+			} else {
+				m_statsToFile = true;
+			}
+		} else if ( SwitchMatch(args[j], _T("record") )) {
+			if (++j == i) {
+				ArgError(_T("No recording file specified"));
+				continue;
+			}
+			if (_stscanf(args[j], _T("%s"), &m_recordFilename) != 1) {
+				ArgError(_T("Invalid recording file specified"));
+				continue;
+			} else {
+				m_recordToFile = true;
+			}
 		} else {
 			TCHAR phost[256];
 			if (!ParseDisplay(args[j], phost, 255, &m_port)) {
@@ -182,9 +287,9 @@ void VNCOptions::ShowUsage(LPTSTR info) {
         tmpinf = info;
     _stprintf(msg, 
 #ifdef UNDER_CE
-        _T("%s\n\rUsage:\n\r  vncviewer [/8bit] [/swapmouse] [/shared] [/belldeiconify] [server:display]"), 
+        _T("%s\n\rUsage:\n\r  vncviewer [/8bit] [/swapmouse] [/shared] [/belldeiconify] [/pointerinterval ms] [/fullupdates] [/backgroundinterval ms] [/nopipeline] [/nocontinuous] [/noautoselect] [/noautodepth] [/compresslevel n] [/quality n] [/nojpeg] [/nolocalcursor] [/statsfile file] [/record file] [server:display]"), 
 #else
-        _T("%s\n\rUsage:\n\r  vncviewer [/8bit] [/swapmouse] [/shared] [/belldeiconify] [/listen] [server:display]"), 
+        _T("%s\n\rUsage:\n\r  vncviewer [/8bit] [/swapmouse] [/shared] [/belldeiconify] [/pointerinterval ms] [/fullupdates] [/backgroundinterval ms] [/nopipeline] [/nocontinuous] [/noautoselect] [/noautodepth] [/compresslevel n] [/quality n] [/nojpeg] [/nolocalcursor] [/statsfile file] [/record file] [/listen] [server:display]"), 
 #endif
         tmpinf);
     MessageBox(NULL,  msg, _T("VNC error"), MB_OK | MB_ICONSTOP | MB_TOPMOST);
@@ -25,7 +25,7 @@
 
 #pragma once
 
-#define LASTENCODING rfbEncodingHextile
+#define LASTENCODING rfbEncodingZRLE
 
 class VNCOptions  
 {
@@ -46,6 +46,32 @@ public:
 	bool    m_Emul3Buttons;  // not implemented yet
 	bool	m_Shared;
 	bool	m_DeiconifyOnBell;
+	// Minimum time in ms between pointer movements sent to the server.
+	// Movements in between are merged.  0 sends every movement.
+	int		m_PointerInterval;
+	// Ask only for updates to the part of the desktop in the window,
+	// and for the rest of it every m_BackgroundInterval ms.
+	bool	m_ViewportUpdates;
+	int		m_BackgroundInterval;
+	// Ask for the next update as soon as one starts to arrive, rather 
+	// than when it has been drawn, to hide the network round trip.
+	bool	m_PipelineUpdates;
+	// Tell the server how hard to compress (0-9), and whether it may use
+	// JPEG and at what quality (0-9).  -1 leaves it to the server, and 
+	// for the quality level means no JPEG.
+	int		m_CompressLevel;
+	int		m_QualityLevel;
+	// Ask the server for the cursor's shape and draw it ourselves, so 
+	// moving the pointer doesn't need an update from the server.
+	bool	m_LocalCursor;
+	// Have the server send updates as things change, if it can, rather 
+	// than wait to be asked for each one.
+	bool	m_ContinuousUpdates;
+	// Ask for whichever encoding is measured to be quickest to receive 
+	// and decode, rather than always the preferred one.
+	bool	m_AutoSelect;
+	// Ask for smaller pixels while the link is too slow for the server's
+	bool	m_AutoDepth;
 
 	// Keyboard can be specified on command line as 8-digit hex
 	TCHAR	m_kbdname[9];
@@ -62,6 +88,13 @@ public:
     int     m_logLevel;
     bool    m_logToFile, m_logToConsole;
     TCHAR   m_logFilename[1024];
+
+	// Where to write connection statistics every few seconds
+	bool	m_statsToFile;
+	TCHAR	m_statsFilename[1024];
+	// Where to record everything the server sends, for playing back later
+	bool	m_recordToFile;
+	TCHAR	m_recordFilename[1024];
     
 	// for debugging purposes
 	int m_delay;
@@ -0,0 +1,115 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// ZlibInStream.cpp
+// Incremental decompression of zlib streams.
+
+#include <string.h>
+#include "ZlibInStream.h"
+
+ZlibInStream::ZlibInStream()
+{
+	memset(&m_stream, 0, sizeof(m_stream));
+	m_initialised = false;
+	m_ptr = m_end = m_buf;
+	m_bytesIn = m_bytesOut = 0;
+}
+
+ZlibInStream::~ZlibInStream()
+{
+	if (m_initialised)
+		inflateEnd(&m_stream);
+}
+
+void ZlibInStream::SetInput(const CARD8 *data, int len)
+{
+	// The stream isn't started until it's used, because servers only
+	// create theirs when they first send us something.
+	if (!m_initialised) {
+		memset(&m_stream, 0, sizeof(m_stream));
+		if (inflateInit(&m_stream) != Z_OK) return;
+		m_initialised = true;
+	}
+	m_stream.next_in = (Bytef *) data;
+	m_stream.avail_in = len;
+	m_bytesIn += len;
+}
+
+const CARD8 *ZlibInStream::Get(int n)
+{
+	if (n > ZLIBOUTBUFSIZE) return NULL;
+
+	while (m_end - m_ptr < n) {
+		// Make room after what we've already got
+		int have = m_end - m_ptr;
+		if (m_ptr != m_buf) {
+			memmove(m_buf, m_ptr, have);
+			m_ptr = m_buf;
+			m_end = m_buf + have;
+		}
+		if (!Inflate()) return NULL;
+	}
+
+	const CARD8 *p = m_ptr;
+	m_ptr += n;
+	return p;
+}
+
+bool ZlibInStream::FinishInput()
+{
+	bool ok = true;
+	while (ok && m_initialised && m_stream.avail_in > 0) {
+		m_ptr = m_end = m_buf;
+		ok = Inflate();
+	}
+	m_ptr = m_end = m_buf;
+	return ok;
+}
+
+void ZlibInStream::Reset()
+{
+	if (m_initialised)
+		inflateEnd(&m_stream);
+	m_initialised = false;
+	m_ptr = m_end = m_buf;
+}
+
+// Decompress as much as will fit after m_end.  Fails if nothing 
+// could be produced.
+bool ZlibInStream::Inflate()
+{
+	if (!m_initialised || m_stream.avail_in == 0) return false;
+
+	m_stream.next_out = m_end;
+	m_stream.avail_out = m_buf + ZLIBOUTBUFSIZE - m_end;
+
+	int err = inflate(&m_stream, Z_SYNC_FLUSH);
+	if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+		return false;
+
+	int produced = (CARD8 *) m_stream.next_out - m_end;
+	m_end += produced;
+	m_bytesOut += produced;
+	return produced > 0 || err == Z_OK;
+}
@@ -0,0 +1,73 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// ZlibInStream.h
+// One of the server's zlib streams.  Compressed data is handed over a
+// block at a time, and the decompressed data can then be taken out in 
+// pieces of any size up to ZLIBOUTBUFSIZE, without needing to know how 
+// big the whole thing is.  The stream carries on from one block to the
+// next, as RFB requires.  Nothing in here depends on Windows.
+
+#pragma once
+
+#include "rfb.h"
+#include "ByteSource.h"
+#include "zlib.h"
+
+// Enough for a 64x64 tile of 3-byte pixels, with room to spare
+#define ZLIBOUTBUFSIZE 16384
+
+class ZlibInStream : public ByteSource
+{
+public:
+	ZlibInStream();
+	virtual ~ZlibInStream();
+
+	// The next block of compressed data.  It must stay where it is until
+	// it has all been used.
+	void SetInput(const CARD8 *data, int len);
+
+	// Returns the next n bytes of decompressed data, or NULL if the data
+	// is corrupt or the input runs out first.  The pointer is only good 
+	// until the next call.
+	const CARD8 *Get(int n);
+
+	// Decompress and throw away whatever is left of the input, ready 
+	// for the next block.  Returns false if the data is corrupt.
+	bool FinishInput();
+
+	// Start again, when the server says it has started a new stream.
+	void Reset();
+
+	// Compressed bytes taken in, and decompressed bytes given out
+	unsigned long m_bytesIn, m_bytesOut;
+
+private:
+	bool Inflate();
+
+	z_stream m_stream;
+	bool m_initialised;
+	CARD8 m_buf[ZLIBOUTBUFSIZE];
+	CARD8 *m_ptr, *m_end;
+};
@@ -42,6 +42,11 @@
 #define IDC_RBSRADIO                    1021
 #define IDC_CORRERADIO                  1022
 #define IDC_HEXTILERADIO                1023
+#define IDC_ZLIBRADIO                   1024
+#define IDC_TIGHTRADIO                  1025
+#define IDC_ZLIBHEXRADIO                1026
+#define IDC_TRLERADIO                   1033
+#define IDC_ZRLERADIO                   1034
 #define ID_SESSION_SET_CRECT            32777
 #define ID_SESSION_SWAPMOUSE            32785
 #define ID_CLOSEDAEMON                  40001
@@ -30,9 +30,15 @@
 #ifndef RFB_H__
 #define RFB_H__
 
-// Define the CARD* types as used in X11/Xmd.h
+// Define the CARD* types as used in X11/Xmd.h.  CARD32 must be exactly
+// 32 bits, which long isn't on 64-bit Unix.
 
+#include <limits.h>
+#if ULONG_MAX == 0xffffffffUL
 typedef unsigned long CARD32;
+#else
+typedef unsigned int CARD32;
+#endif
 typedef unsigned short CARD16;
 typedef short INT16;
 typedef unsigned char  CARD8;
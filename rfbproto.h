@@ -268,6 +268,8 @@ typedef struct {
 #define rfbSetColourMapEntries 1
 #define rfbBell 2
 #define rfbServerCutText 3
+#define rfbEndOfContinuousUpdates 150
+#define rfbServerFence 248
 
 
 /* client -> server */
@@ -279,6 +281,8 @@ typedef struct {
 #define rfbKeyEvent 4
 #define rfbPointerEvent 5
 #define rfbClientCutText 6
+#define rfbEnableContinuousUpdates 150
+#define rfbClientFence 248
 
 
 
@@ -294,6 +298,114 @@ typedef struct {
 #define rfbEncodingRRE 2
 #define rfbEncodingCoRRE 4
 #define rfbEncodingHextile 5
+#define rfbEncodingZlib 6
+#define rfbEncodingTight 7
+#define rfbEncodingZlibHex 8
+#define rfbEncodingTRLE 15
+#define rfbEncodingZRLE 16
+
+/*
+ * Pseudo-encodings.  These are never used for rectangles, but tell the
+ * server about things the client would like.  The compression level says
+ * how hard the server should try to compress, and the quality level allows
+ * JPEG to be used in Tight encoding, and how lossy it may be.
+ */
+
+#define rfbEncodingCompressLevel0 0xFFFFFF00
+#define rfbEncodingCompressLevel9 0xFFFFFF09
+#define rfbEncodingQualityLevel0  0xFFFFFFE0
+#define rfbEncodingQualityLevel9  0xFFFFFFE9
+
+/*
+ * Cursor shape pseudo-encodings.  If the client asks for these, the server
+ * doesn't draw the cursor into the framebuffer, and instead sends its shape
+ * as a rectangle with one of these encodings whenever it changes.  The
+ * rectangle's x and y are the hotspot, and its width and height the size
+ * of the cursor.  A size of 0x0 means there's no cursor to show.
+ *
+ * XCursor: an rfbXCursorColors giving the foreground and background
+ * colours, then a bitmap which is set for foreground pixels, then a bitmap
+ * which is set for the pixels to be drawn.  Each bitmap row starts on a
+ * byte boundary, with the leftmost pixel in the most significant bit.
+ *
+ * RichCursor: width*height pixels in the client's pixel format, then a
+ * bitmap like XCursor's which is set for the pixels to be drawn.
+ */
+
+#define rfbEncodingXCursor        0xFFFFFF10
+#define rfbEncodingRichCursor     0xFFFFFF11
+
+typedef struct {
+    CARD8 foreRed;
+    CARD8 foreGreen;
+    CARD8 foreBlue;
+    CARD8 backRed;
+    CARD8 backGreen;
+    CARD8 backBlue;
+} rfbXCursorColors;
+
+#define sz_rfbXCursorColors 6
+
+/*
+ * PointerPos pseudo-encoding.  The server sends a rectangle of this 
+ * encoding, with no data, when the pointer has moved other than by the
+ * client's pointer events.  Its x and y are the new position.
+ */
+
+#define rfbEncodingPointerPos     0xFFFFFF18
+
+/*
+ * Desktop size pseudo-encodings.  The server sends a rectangle of one of
+ * these encodings when the framebuffer changes size; its width and height
+ * are the new size, and the rectangles after it are for the new 
+ * framebuffer.
+ *
+ * NewFBSize (DesktopSize) has no data.  ExtDesktopSize's x is the reason
+ * for the change and its y a status, which is non-zero if a change asked 
+ * for by this client failed.  It is followed by an rfbExtDesktopSizeHeader
+ * and that many rfbExtDesktopScreens.
+ */
+
+#define rfbEncodingNewFBSize      0xFFFFFF21
+
+/*
+ * LastRect pseudo-encoding.  A server which doesn't know how many 
+ * rectangles an update will have can send 0xFFFF as the number, and end
+ * the update with a rectangle of this encoding, which has no data.
+ */
+
+#define rfbEncodingLastRect       0xFFFFFF20
+#define rfbUnknownNumberOfRects   0xFFFF
+
+/*
+ * ContinuousUpdates and Fence pseudo-encodings, which say the client 
+ * understands the messages of those names.  A server which supports
+ * continuous updates replies with an EndOfContinuousUpdates message, and
+ * one which supports fences sends a fence.
+ */
+
+#define rfbEncodingContinuousUpdates 0xFFFFFEC7
+#define rfbEncodingFence             0xFFFFFEC8
+#define rfbEncodingExtDesktopSize 0xFFFFFECC
+
+typedef struct {
+    CARD8 numberOfScreens;
+    CARD8 pad1;
+    CARD16 pad2;
+} rfbExtDesktopSizeHeader;
+
+#define sz_rfbExtDesktopSizeHeader 4
+
+typedef struct {
+    CARD32 id;
+    CARD16 x;
+    CARD16 y;
+    CARD16 width;
+    CARD16 height;
+    CARD32 flags;
+} rfbExtDesktopScreen;
+
+#define sz_rfbExtDesktopScreen 16
 
 
 
@@ -434,6 +546,18 @@ typedef struct {
 #define rfbHextileAnySubrects		(1 << 3)
 #define rfbHextileSubrectsColoured	(1 << 4)
 
+/*
+ * ZlibHex is Hextile with two more subencoding bits.  If ZlibRaw is set, a
+ * CARD16 length follows, then that much zlib data which inflates to the
+ * tile's raw pixels.  If ZlibHex is set, a CARD16 length follows, then zlib
+ * data which inflates to the rest of the tile as Hextile would send it.  Raw
+ * tiles and Hextile-encoded tiles each use their own zlib stream, which
+ * carries on for the whole connection.
+ */
+
+#define rfbHextileZlibRaw		(1 << 5)
+#define rfbHextileZlibHex		(1 << 6)
+
 #define rfbHextilePackXY(x,y) (((x) << 4) | (y))
 #define rfbHextilePackWH(w,h) ((((w)-1) << 4) | ((h)-1))
 #define rfbHextileExtractX(byte) ((byte) >> 4)
@@ -442,6 +566,101 @@ typedef struct {
 #define rfbHextileExtractH(byte) (((byte) & 0xf) + 1)
 
 
+/*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ * Zlib - the rectangle's pixels as for Raw, but compressed.  The rectangle
+ * starts with a CARD32 giving the length of the zlib data which follows.  A
+ * single zlib stream is used for the whole connection.
+ */
+
+typedef struct {
+    CARD32 nBytes;
+} rfbZlibHeader;
+
+#define sz_rfbZlibHeader 4
+
+
+/*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ * ZRLE - encoding combining Zlib compression, tiling, palettisation and
+ * run-length encoding.  The rectangle starts with a CARD32 giving the length
+ * of the zlib data which follows.  A single zlib stream is used for the whole
+ * connection.  The uncompressed data is a series of 64x64 tiles, left to
+ * right and top to bottom, each starting with a subencoding byte:
+ *
+ *   0       - raw pixels
+ *   1       - a single pixel value for the whole tile
+ *   2-16    - a palette of that many pixels, then packed 1, 2 or 4-bit
+ *             indices, each row starting on a byte boundary
+ *   128     - plain RLE: runs of a pixel value and a length
+ *   130-255 - palette RLE: a palette of (subencoding-128) pixels, then runs
+ *             of an index, with a length following if its top bit is set
+ *
+ * Run lengths are sent less one, as bytes which are added up, all but the
+ * last being 255.  Pixels are sent as "CPIXELs", which are 3 bytes rather
+ * than 4 for true-colour 32-bit formats of depth 24 or less whose pixels fit
+ * in either the top or bottom 3 bytes.
+ */
+
+#define rfbZRLETileWidth 64
+#define rfbZRLETileHeight 64
+
+typedef struct {
+    CARD32 length;
+} rfbZRLEHeader;
+
+#define sz_rfbZRLEHeader 4
+
+
+/*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ * TRLE - ZRLE without the zlib compression, and with 16x16 tiles.  There is
+ * no length at the start; the tiles follow the rectangle header directly.
+ * As well as ZRLE's subencodings, a tile may be:
+ *
+ *   127     - packed indices into the previous tile's palette
+ *   129     - palette RLE using the previous tile's palette
+ */
+
+#define rfbTRLETileWidth 16
+#define rfbTRLETileHeight 16
+
+
+/*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ * Tight encoding.  The rectangle starts with a compression control byte.  The
+ * low 4 bits say which of the four zlib streams should be reset before the
+ * data is decoded.  The high 4 bits give the type of compression:
+ *
+ *   1000      - fill: a single pixel value for the whole rectangle
+ *   1001      - JPEG: a compact length, then a JPEG image
+ *   0xyy      - basic: zlib stream yy is used.  If x is set a filter id
+ *               byte follows: copy, palette or gradient.  A palette is a
+ *               byte giving the number of colours less one, then the
+ *               colours.  Two-colour palettes use 1-bit indices, with each
+ *               row starting on a byte boundary, and bigger ones 8-bit.
+ *
+ * Data from the filter which comes to less than rfbTightMinToCompress bytes
+ * is sent as it is; otherwise it is sent as a compact length followed by
+ * that much zlib data.  A compact length is 1 to 3 bytes, 7 bits in each of
+ * the first two, least significant first, with the top bit set if another
+ * byte follows.  The third byte has all 8 bits.
+ *
+ * Pixels are sent as "TPIXELs", which are 3 bytes of red, green and blue
+ * for 32-bit formats of depth 24 with 8 bits per colour.  The gradient
+ * filter sends each colour component as its difference from the value
+ * predicted from the pixels to the left, above, and above left.
+ */
+
+#define rfbTightExplicitFilter 0x04
+#define rfbTightFill 0x08
+#define rfbTightJpeg 0x09
+#define rfbTightMaxSubencoding 0x09
+
+#define rfbTightFilterCopy 0x00
+#define rfbTightFilterPalette 0x01
+#define rfbTightFilterGradient 0x02
+
+#define rfbTightMinToCompress 12
+#define rfbTightMaxRectWidth 2048
+
+
 /*-----------------------------------------------------------------------------
  * SetColourMapEntries - these messages are only sent if the pixel
  * format uses a "colour map" (i.e. trueColour false) and the client has not
@@ -493,6 +712,42 @@ typedef struct {
 #define sz_rfbServerCutTextMsg 8
 
 
+/*-----------------------------------------------------------------------------
+ * EndOfContinuousUpdates - the server has stopped sending continuous updates,
+ * or, the first time, that it can send them.  It is just the type byte.
+ */
+
+#define sz_rfbEndOfContinuousUpdatesMsg 1
+
+
+/*-----------------------------------------------------------------------------
+ * Fence - sent in either direction.  If the Request flag is set, the other
+ * end sends the fence back with the flags it supports once it has dealt
+ * with everything before it, and the payload unchanged.  Otherwise it is
+ * such a reply.  BlockBefore and BlockAfter ask that everything before the
+ * fence is finished before it is replied to, and that nothing after it is
+ * started until then.  SyncNext asks for the next message to be handled
+ * as if it were a fence.
+ */
+
+#define rfbFenceFlagBlockBefore (1 << 0)
+#define rfbFenceFlagBlockAfter  (1 << 1)
+#define rfbFenceFlagSyncNext    (1 << 2)
+#define rfbFenceFlagRequest     0x80000000
+#define rfbFenceMaxPayload      64
+
+typedef struct {
+    CARD8 type;			/* always rfbServerFence or rfbClientFence */
+    CARD8 pad1;
+    CARD16 pad2;
+    CARD32 flags;
+    CARD8 length;
+    /* followed by char payload[length] */
+} rfbFenceMsg;
+
+#define sz_rfbFenceMsg 9
+
+
 /*-----------------------------------------------------------------------------
  * Union of all server->client messages.
  */
@@ -660,6 +915,24 @@ typedef struct {
 
 
 
+/*-----------------------------------------------------------------------------
+ * EnableContinuousUpdates - ask the server to send updates for an area as
+ * soon as it changes, without waiting for update requests, or to stop.
+ * When it stops it sends EndOfContinuousUpdates.
+ */
+
+typedef struct {
+    CARD8 type;			/* always rfbEnableContinuousUpdates */
+    CARD8 enable;
+    CARD16 x;
+    CARD16 y;
+    CARD16 w;
+    CARD16 h;
+} rfbEnableContinuousUpdatesMsg;
+
+#define sz_rfbEnableContinuousUpdatesMsg 10
+
+
 /*-----------------------------------------------------------------------------
  * Union of all client->server messages.
  */
@@ -0,0 +1,213 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// BenchPipeline.cpp
+// Compares the update rate and the delay before updates are seen with
+// and without update pipelining, over links of different round-trip 
+// times.  A stand-in server on the loopback interface answers each
+// FramebufferUpdateRequest with a raw update, holding it back until a
+// round trip after the request was sent, and stamping it with the time
+// half way through.  The client reads updates the
+// way ClientConnection's run loop does, asking for the next one either
+// before it decodes the current one or after, and spends a fixed time 
+// "decoding" each.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rfb.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+#define UPDATES 40
+#define DECODE_MS 10
+#define UPDATESIZE (sz_rfbFramebufferUpdateMsg + sz_rfbFramebufferUpdateRectHeader + WIDTH * HEIGHT * 4)
+
+// When the client sent each request, and the round-trip time the 
+// server adds
+static double requestTime[UPDATES + 1];
+static double rtt;
+
+static double Now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Wait(double until)
+{
+	double now = Now();
+	if (until > now)
+		usleep((useconds_t) ((until - now) * 1e6));
+}
+
+static void Fail(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void SendAll(int s, const char *buf, int len)
+{
+	for (int sent = 0; sent < len; ) {
+		int n = send(s, buf + sent, len - sent, 0);
+		if (n <= 0) Fail("send");
+		sent += n;
+	}
+}
+
+static void RecvAll(int s, char *buf, int len)
+{
+	for (int got = 0; got < len; ) {
+		int n = recv(s, buf + got, len - got, 0);
+		if (n <= 0) Fail("recv");
+		got += n;
+	}
+}
+
+// Answers UPDATES requests, each with a screenful of raw pixels which 
+// starts with the time it was sent.
+static void *Server(void *arg)
+{
+	int listener = *(int *) arg;
+	int s = accept(listener, NULL, NULL);
+	if (s < 0) Fail("accept");
+	close(listener);
+
+	char *update = new char[UPDATESIZE];
+	memset(update, 0, UPDATESIZE);
+	rfbFramebufferUpdateMsg *fu = (rfbFramebufferUpdateMsg *) update;
+	fu->type = rfbFramebufferUpdate;
+	fu->nRects = Swap16IfLE(1);
+	rfbFramebufferUpdateRectHeader *rh = 
+		(rfbFramebufferUpdateRectHeader *) (update + sz_rfbFramebufferUpdateMsg);
+	rh->r.w = Swap16IfLE(WIDTH);
+	rh->r.h = Swap16IfLE(HEIGHT);
+	rh->encoding = Swap32IfLE(rfbEncodingRaw);
+	char *pixels = update + sz_rfbFramebufferUpdateMsg + sz_rfbFramebufferUpdateRectHeader;
+
+	for (int u = 0; u < UPDATES; u++) {
+		rfbFramebufferUpdateRequestMsg fur;
+		RecvAll(s, (char *) &fur, sz_rfbFramebufferUpdateRequestMsg);
+		// The request takes half the round trip to get here, and the 
+		// update the other half to get back
+		Wait(requestTime[u] + rtt / 2);
+		double now = Now();
+		memcpy(pixels, &now, sizeof(now));
+		Wait(now + rtt / 2);
+		SendAll(s, update, UPDATESIZE);
+	}
+	delete [] update;
+	close(s);
+	return NULL;
+}
+
+// Start a server thread and connect to it
+static int Connect(pthread_t *thread)
+{
+	static int listener;
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(listener, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+		listen(listener, 1) < 0 ||
+		getsockname(listener, (sockaddr *) &addr, &len) < 0)
+		Fail("listen");
+	pthread_create(thread, NULL, Server, &listener);
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(s, (sockaddr *) &addr, sizeof(addr)) < 0) Fail("connect");
+	return s;
+}
+
+static void SendRequest(int s, int n)
+{
+	rfbFramebufferUpdateRequestMsg fur;
+	memset(&fur, 0, sizeof(fur));
+	fur.type = rfbFramebufferUpdateRequest;
+	fur.incremental = 1;
+	fur.w = Swap16IfLE(WIDTH);
+	fur.h = Swap16IfLE(HEIGHT);
+	requestTime[n] = Now();
+	SendAll(s, (char *) &fur, sz_rfbFramebufferUpdateRequestMsg);
+}
+
+// Reads all the updates, as the run loop does, and reports the updates
+// per second and how long after being made each was on the screen.
+static void Bench(bool pipeline)
+{
+	pthread_t thread;
+	int s = Connect(&thread);
+	char *update = new char[UPDATESIZE];
+	double delay = 0;
+	int requests = 0;
+
+	double start = Now();
+	SendRequest(s, requests++);
+	for (int u = 0; u < UPDATES; u++) {
+		RecvAll(s, update, 1);
+		bool requested = false;
+		if (pipeline && requests < UPDATES) {
+			SendRequest(s, requests++);
+			requested = true;
+		}
+		RecvAll(s, update + 1, UPDATESIZE - 1);
+		Wait(Now() + DECODE_MS / 1000.0);
+		double sent;
+		memcpy(&sent, update + sz_rfbFramebufferUpdateMsg + sz_rfbFramebufferUpdateRectHeader, sizeof(sent));
+		delay += Now() - sent;
+		if (!requested && requests < UPDATES)
+			SendRequest(s, requests++);
+	}
+	double secs = Now() - start;
+	pthread_join(thread, NULL);
+	close(s);
+	delete [] update;
+	printf("  %-12s %6.1f updates/s, %6.1f ms from made to seen\n", 
+		pipeline ? "Pipelined" : "One at once", UPDATES / secs, delay * 1000 / UPDATES);
+}
+
+int main()
+{
+	static const int rtts[] = { 0, 10, 50, 100 };
+	printf("%d updates of %dx%d raw, %d ms to decode each\n", 
+		UPDATES, WIDTH, HEIGHT, DECODE_MS);
+	for (unsigned i = 0; i < sizeof(rtts) / sizeof(rtts[0]); i++) {
+		rtt = rtts[i] / 1000.0;
+		printf("Round trip %d ms:\n", rtts[i]);
+		Bench(false);
+		Bench(true);
+	}
+	return 0;
+}
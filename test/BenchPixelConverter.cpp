@@ -0,0 +1,90 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// BenchPixelConverter.cpp
+// How many million pixels a second each way of converting them manages.
+// "Arithmetic" is the COLOR_FROM_PIXEL macros' way, with a divide per 
+// channel; "General" is PixelConverter's table-driven row converter for 
+// any layout of that size, and "Fixed" the one ConvertRow actually uses,
+// which for the common layouts has the shifts and masks built in.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "PixelConverter.h"
+#include "OldPixel.h"
+
+#define ROWPIXELS 1024
+#define ROWS 256
+#define PASSES 20
+
+static CARD8 src[ROWPIXELS * ROWS * 4];
+static CARD32 dst[ROWPIXELS * ROWS];
+
+static double MPixelsPerSec(clock_t start)
+{
+	double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+	return (double) ROWPIXELS * ROWS * PASSES / 1e6 / (secs > 0 ? secs : 1e-9);
+}
+
+static void Bench(const char *name, const rfbPixelFormat &pf)
+{
+	int bpp = pf.bitsPerPixel / 8;
+	int rowBytes = ROWPIXELS * bpp;
+
+	clock_t start = clock();
+	for (int pass = 0; pass < PASSES; pass++)
+		for (int i = 0; i < ROWPIXELS * ROWS; i++)
+			dst[i] = OldPixelAt(pf, src + i * bpp);
+	double old = MPixelsPerSec(start);
+
+	double rates[2];
+	for (int specialised = 0; specialised < 2; specialised++) {
+		PixelConverter conv;
+		conv.SetFormat(pf, specialised != 0);
+		start = clock();
+		for (int pass = 0; pass < PASSES; pass++)
+			for (int y = 0; y < ROWS; y++)
+				conv.ConvertRow(src + y * rowBytes, dst + y * ROWPIXELS, ROWPIXELS);
+		rates[specialised] = MPixelsPerSec(start);
+	}
+
+	printf("%-14s arithmetic %7.1f  general %7.1f  fixed %7.1f MPixel/s\n", 
+		name, old, rates[0], rates[1]);
+}
+
+int main()
+{
+	srand(1);
+	for (int i = 0; i < (int) sizeof(src); i++)
+		src[i] = (CARD8) rand();
+
+	Bench("8-bit", format8);
+	Bench("16-bit BGR556", format16);
+	Bench("16-bit RGB565", format565);
+	Bench("16-bit RGB555", format555);
+	Bench("32-bit RGB888", format32);
+	Bench("32-bit BGR888", format32BGR);
+	return 0;
+}
@@ -0,0 +1,374 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// BenchReader.cpp
+// Reads Hextile updates from a stand-in server over the loopback 
+// interface, the way ClientConnection used to, with a recv for each
+// field, and the way it does now, through an input buffer.  Reports the
+// recv calls made and the throughput.  ClientConnection itself needs
+// Windows, so its two ways of reading are reproduced here; they follow
+// ReadExact, ReadExactPtr and FillInputBuffer line for line.
+//
+// It also measures what the read mutex, which ReadExact used to take on
+// every call, costs on top of the buffered reader, both when no other 
+// thread wants it and when one keeps taking it.  A pthread mutex stands
+// in for the critical section under omni_mutex.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rfb.h"
+
+#define INPUTBUFSIZE 8192
+#define WIDTH 640
+#define HEIGHT 480
+#define UPDATES 50
+
+// The stand-in server's data: UPDATES updates, each one Hextile 
+// rectangle covering the screen, with a mixture of raw tiles and tiles
+// of solid-colour and coloured subrectangles.
+static char *stream;
+static int streamLen;
+
+static void Put(char *&p, const void *data, int len)
+{
+	memcpy(p, data, len);
+	p += len;
+}
+
+static void MakeStream()
+{
+	stream = new char[UPDATES * (16 + WIDTH * HEIGHT * 4 + (WIDTH / 16) * (HEIGHT / 16) * 64)];
+	char *p = stream;
+	srand(1);
+	for (int u = 0; u < UPDATES; u++) {
+		rfbFramebufferUpdateMsg fu;
+		memset(&fu, 0, sizeof(fu));
+		fu.type = rfbFramebufferUpdate;
+		fu.nRects = Swap16IfLE(1);
+		Put(p, &fu, sz_rfbFramebufferUpdateMsg);
+		rfbFramebufferUpdateRectHeader rh;
+		rh.r.x = rh.r.y = 0;
+		rh.r.w = Swap16IfLE(WIDTH);
+		rh.r.h = Swap16IfLE(HEIGHT);
+		rh.encoding = Swap32IfLE(rfbEncodingHextile);
+		Put(p, &rh, sz_rfbFramebufferUpdateRectHeader);
+
+		for (int t = 0; t < (WIDTH / 16) * (HEIGHT / 16); t++) {
+			int kind = rand() % 8;
+			CARD8 subenc;
+			if (kind == 0) {
+				subenc = rfbHextileRaw;
+				Put(p, &subenc, 1);
+				for (int i = 0; i < 16 * 16 * 4; i++)
+					*p++ = (char) rand();
+				continue;
+			}
+			CARD8 nSubrects = (CARD8) (rand() % 8);
+			bool coloured = (kind == 1);
+			subenc = rfbHextileBackgroundSpecified;
+			if (nSubrects > 0) {
+				subenc |= rfbHextileAnySubrects;
+				subenc |= coloured ? rfbHextileSubrectsColoured : rfbHextileForegroundSpecified;
+			}
+			Put(p, &subenc, 1);
+			CARD32 pix = rand();
+			Put(p, &pix, 4);
+			if (nSubrects == 0) continue;
+			if (!coloured)
+				Put(p, &pix, 4);
+			Put(p, &nSubrects, 1);
+			for (int s = 0; s < nSubrects; s++) {
+				if (coloured)
+					Put(p, &pix, 4);
+				*p++ = (char) rand();
+				*p++ = (char) rand();
+			}
+		}
+	}
+	streamLen = p - stream;
+}
+
+static void Fail(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *Server(void *arg)
+{
+	int listener = *(int *) arg;
+	int s = accept(listener, NULL, NULL);
+	if (s < 0) Fail("accept");
+	close(listener);
+	for (int sent = 0; sent < streamLen; ) {
+		int n = send(s, stream + sent, streamLen - sent, 0);
+		if (n <= 0) Fail("send");
+		sent += n;
+	}
+	close(s);
+	return NULL;
+}
+
+// Start a server thread and connect to it
+static int Connect(pthread_t *thread)
+{
+	static int listener;
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(listener, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+		listen(listener, 1) < 0 ||
+		getsockname(listener, (sockaddr *) &addr, &len) < 0)
+		Fail("listen");
+	pthread_create(thread, NULL, Server, &listener);
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(s, (sockaddr *) &addr, sizeof(addr)) < 0) Fail("connect");
+	return s;
+}
+
+// How the viewer used to read: every field with its own recv
+class UnbufferedReader
+{
+public:
+	UnbufferedReader(int sock) : m_sock(sock), m_recvCalls(0) {}
+
+	void ReadExact(char *buf, int wanted) {
+		while (wanted > 0) {
+			int bytes = recv(m_sock, buf, wanted, 0);
+			m_recvCalls++;
+			if (bytes <= 0) Fail("recv");
+			buf += bytes;
+			wanted -= bytes;
+		}
+	}
+	char *ReadExactPtr(int wanted) {
+		ReadExact(m_scratch, wanted);
+		return m_scratch;
+	}
+
+	int m_sock;
+	unsigned long m_recvCalls;
+	char m_scratch[INPUTBUFSIZE];
+};
+
+// How it reads now: as much as recv will give into an input buffer,
+// with fields taken from there
+class BufferedReader
+{
+public:
+	BufferedReader(int sock) : m_sock(sock), m_recvCalls(0) {
+		m_inptr = m_inend = m_inbuf;
+	}
+
+	void FillInputBuffer(int wanted) {
+		int have = m_inend - m_inptr;
+		if (m_inptr != m_inbuf) {
+			memmove(m_inbuf, m_inptr, have);
+			m_inptr = m_inbuf;
+			m_inend = m_inbuf + have;
+		}
+		while (have < wanted) {
+			int bytes = recv(m_sock, m_inend, INPUTBUFSIZE - have, 0);
+			m_recvCalls++;
+			if (bytes <= 0) Fail("recv");
+			m_inend += bytes;
+			have += bytes;
+		}
+	}
+	void ReadExact(char *buf, int wanted) {
+		int n = wanted < m_inend - m_inptr ? wanted : m_inend - m_inptr;
+		if (n > 0) {
+			memcpy(buf, m_inptr, n);
+			m_inptr += n;
+			buf += n;
+			wanted -= n;
+		}
+		if (wanted == 0) return;
+		if (wanted < INPUTBUFSIZE) {
+			FillInputBuffer(wanted);
+			memcpy(buf, m_inptr, wanted);
+			m_inptr += wanted;
+			return;
+		}
+		while (wanted > 0) {
+			int bytes = recv(m_sock, buf, wanted, 0);
+			m_recvCalls++;
+			if (bytes <= 0) Fail("recv");
+			buf += bytes;
+			wanted -= bytes;
+		}
+	}
+	char *ReadExactPtr(int wanted) {
+		if (m_inend - m_inptr < wanted)
+			FillInputBuffer(wanted);
+		char *p = m_inptr;
+		m_inptr += wanted;
+		return p;
+	}
+
+	int m_sock;
+	unsigned long m_recvCalls;
+	char m_inbuf[INPUTBUFSIZE];
+	char *m_inptr, *m_inend;
+};
+
+// Either of the above with the lock taken around every read, as
+// m_readMutex was
+template <class Reader>
+class LockedReader : public Reader
+{
+public:
+	LockedReader(int sock) : Reader(sock) {}
+
+	void ReadExact(char *buf, int wanted) {
+		pthread_mutex_lock(&readMutex);
+		Reader::ReadExact(buf, wanted);
+		pthread_mutex_unlock(&readMutex);
+	}
+	char *ReadExactPtr(int wanted) {
+		pthread_mutex_lock(&readMutex);
+		char *p = Reader::ReadExactPtr(wanted);
+		pthread_mutex_unlock(&readMutex);
+		return p;
+	}
+
+	static pthread_mutex_t readMutex;
+};
+
+template <class Reader>
+pthread_mutex_t LockedReader<Reader>::readMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Another thread which keeps taking the reader's lock, while contending
+static volatile bool contending;
+
+static void *Contender(void *arg)
+{
+	pthread_mutex_t *m = (pthread_mutex_t *) arg;
+	while (contending) {
+		pthread_mutex_lock(m);
+		pthread_mutex_unlock(m);
+	}
+	return NULL;
+}
+
+// Read the updates as the viewer's Hextile decoder does, without drawing
+template <class Reader> 
+static unsigned long ReadUpdates(Reader &r)
+{
+	unsigned long tiles = 0;
+	for (int u = 0; u < UPDATES; u++) {
+		CARD8 msgType;
+		r.ReadExact((char *) &msgType, 1);
+		rfbFramebufferUpdateMsg fu;
+		r.ReadExact((char *) &fu + 1, sz_rfbFramebufferUpdateMsg - 1);
+		rfbFramebufferUpdateRectHeader rh;
+		r.ReadExact((char *) &rh, sz_rfbFramebufferUpdateRectHeader);
+		int w = Swap16IfLE(rh.r.w), h = Swap16IfLE(rh.r.h);
+		for (int y = 0; y < h; y += 16) {
+			for (int x = 0; x < w; x += 16) {
+				CARD8 subenc;
+				CARD32 bg, fg;
+				r.ReadExact((char *) &subenc, 1);
+				tiles++;
+				if (subenc & rfbHextileRaw) {
+					r.ReadExactPtr(16 * 16 * 4);
+					continue;
+				}
+				if (subenc & rfbHextileBackgroundSpecified)
+					r.ReadExact((char *) &bg, 4);
+				if (subenc & rfbHextileForegroundSpecified)
+					r.ReadExact((char *) &fg, 4);
+				if (!(subenc & rfbHextileAnySubrects)) 
+					continue;
+				CARD8 nSubrects;
+				r.ReadExact((char *) &nSubrects, 1);
+				r.ReadExactPtr(nSubrects * ((subenc & rfbHextileSubrectsColoured) ? 6 : 2));
+			}
+		}
+	}
+	return tiles;
+}
+
+static double Now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template <class Reader>
+static void Bench(const char *name)
+{
+	pthread_t thread;
+	int s = Connect(&thread);
+	Reader r(s);
+	double start = Now();
+	unsigned long tiles = ReadUpdates(r);
+	double secs = Now() - start;
+	pthread_join(thread, NULL);
+	close(s);
+	printf("%-12s %8lu recv calls for %lu tiles, %6.1f MB/s\n", 
+		name, r.m_recvCalls, tiles, streamLen / 1e6 / secs);
+}
+
+// The cost of taking and releasing a lock nobody else wants
+static void BenchLock()
+{
+	pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+	const int n = 10000000;
+	double start = Now();
+	for (int i = 0; i < n; i++) {
+		pthread_mutex_lock(&m);
+		pthread_mutex_unlock(&m);
+	}
+	printf("Uncontended lock and unlock: %.1f ns\n", (Now() - start) * 1e9 / n);
+}
+
+int main()
+{
+	MakeStream();
+	printf("%d updates of %dx%d Hextile, %d bytes\n", UPDATES, WIDTH, HEIGHT, streamLen);
+	Bench<UnbufferedReader>("Unbuffered");
+	Bench<BufferedReader>("Buffered");
+
+	BenchLock();
+	Bench<LockedReader<BufferedReader> >("Locked");
+	pthread_t contender;
+	contending = true;
+	pthread_create(&contender, NULL, Contender, &LockedReader<BufferedReader>::readMutex);
+	Bench<LockedReader<BufferedReader> >("Contended");
+	contending = false;
+	pthread_join(contender, NULL);
+	return 0;
+}
@@ -0,0 +1,492 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// BenchTight.cpp
+// Compares Tight with Hextile on two made-up 640x480 screens, one like
+// a desktop with windows and text and one like a photo.  Each is 
+// encoded the way a server would, in the 32-bit format the viewer asks
+// for, then decoded repeatedly.  Reports the bytes each encoding needs
+// and the time taken to decode them.  The decoders follow 
+// HandleHextileTile and ReadTightRect, with the socket replaced by 
+// memory; ClientConnection itself needs Windows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "zlib.h"
+#include "jpeglib.h"
+#include "PixelBuffer.h"
+#include "PixelConverter.h"
+#include "ZlibInStream.h"
+#include "OldPixel.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define REPEATS 50
+// Servers keep Tight rectangles to about this many rows of the screen
+#define TIGHTBAND 64
+#define JPEGQUALITY 75
+
+typedef std::vector<CARD8> Bytes;
+
+static CARD32 screen[WIDTH * HEIGHT];
+static CARD32 bits[WIDTH * HEIGHT];
+static PixelBuffer fb;
+static PixelConverter conv;
+
+static double Now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline CARD32 At(int x, int y)
+{
+	return screen[y * WIDTH + x];
+}
+
+// A blue background with some windows on it, each with a title bar and
+// lines of black "text", and a column of multicoloured icons.
+static void MakeDesktop()
+{
+	srand(1);
+	for (int i = 0; i < WIDTH * HEIGHT; i++)
+		screen[i] = 0x3a6ea5;
+	for (int n = 0; n < 4; n++) {
+		int wx = 60 + n * 120, wy = 30 + n * 80, ww = 300, wh = 200;
+		for (int y = wy; y < wy + wh && y < HEIGHT; y++) {
+			for (int x = wx; x < wx + ww && x < WIDTH; x++) {
+				CARD32 p = y < wy + 18 ? 0x0a246a : 0xffffff;
+				if (y >= wy + 24 && (y - wy - 24) % 14 < 9 && x < wx + ww - 10 &&
+					(x - wx) % 48 < 40 && rand() % 5 < 2)
+					p = 0x000000;
+				screen[y * WIDTH + x] = p;
+			}
+		}
+	}
+	for (int y = 10; y < HEIGHT - 32; y += 60)
+		for (int j = 0; j < 32; j++)
+			for (int i = 0; i < 32; i++)
+				screen[(y + j) * WIDTH + 8 + i] = ((i / 4 + j / 4) & 1) ? 0xffcc00 : 0xc00000 + (i * 8 << 8);
+}
+
+// Smooth changes of colour with some noise
+static void MakePhoto()
+{
+	srand(2);
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			int c[3];
+			c[0] = (int) (128 + 100 * sin(x / 37.0 + y / 53.0));
+			c[1] = (int) (128 + 100 * sin(x / 71.0 - y / 29.0));
+			c[2] = (int) (128 + 100 * cos((x + y) / 97.0));
+			for (int k = 0; k < 3; k++) {
+				c[k] += rand() % 17 - 8;
+				c[k] = c[k] < 0 ? 0 : c[k] > 255 ? 255 : c[k];
+			}
+			screen[y * WIDTH + x] = PIXEL_RGB(c[0], c[1], c[2]);
+		}
+	}
+}
+
+static void PutPixel(Bytes &out, CARD32 p)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((p >> (i * 8)) & 0xff);
+}
+
+// Hextile, with a background and single-row subrectangles of one 
+// colour each, or raw if that would be smaller.
+static void EncodeHextile(Bytes &out)
+{
+	for (int ty = 0; ty < HEIGHT; ty += 16) {
+		for (int tx = 0; tx < WIDTH; tx += 16) {
+			int w = WIDTH - tx < 16 ? WIDTH - tx : 16;
+			int h = HEIGHT - ty < 16 ? HEIGHT - ty : 16;
+			CARD32 bg = At(tx, ty);
+			Bytes subrects;
+			int n = 0;
+			for (int y = 0; y < h && n <= 255; y++) {
+				for (int x = 0; x < w; ) {
+					CARD32 p = At(tx + x, ty + y);
+					int run = 1;
+					while (x + run < w && At(tx + x + run, ty + y) == p) run++;
+					if (p != bg) {
+						PutPixel(subrects, p);
+						subrects.push_back(rfbHextilePackXY(x, y));
+						subrects.push_back(rfbHextilePackWH(run, 1));
+						n++;
+					}
+					x += run;
+				}
+			}
+			if (n > 255 || (int) subrects.size() + 6 > w * h * 4) {
+				out.push_back(rfbHextileRaw);
+				for (int y = 0; y < h; y++)
+					for (int x = 0; x < w; x++)
+						PutPixel(out, At(tx + x, ty + y));
+			} else if (n == 0) {
+				out.push_back(rfbHextileBackgroundSpecified);
+				PutPixel(out, bg);
+			} else {
+				out.push_back(rfbHextileBackgroundSpecified | rfbHextileAnySubrects | 
+					rfbHextileSubrectsColoured);
+				PutPixel(out, bg);
+				out.push_back(n);
+				out.insert(out.end(), subrects.begin(), subrects.end());
+			}
+		}
+	}
+}
+
+static void DecodeHextile(const Bytes &in)
+{
+	const CARD8 *ptr = &in[0];
+	CARD32 bg = 0, fg = 0;
+	for (int ty = 0; ty < HEIGHT; ty += 16) {
+		for (int tx = 0; tx < WIDTH; tx += 16) {
+			int w = WIDTH - tx < 16 ? WIDTH - tx : 16;
+			int h = HEIGHT - ty < 16 ? HEIGHT - ty : 16;
+			CARD8 subencoding = *ptr++;
+			if (subencoding & rfbHextileRaw) {
+				for (int y = 0; y < h; y++, ptr += w * 4)
+					conv.ConvertRow(ptr, fb.Row(ty + y) + tx, w);
+				continue;
+			}
+			if (subencoding & rfbHextileBackgroundSpecified) {
+				bg = conv.PixelAt(ptr);
+				ptr += 4;
+			}
+			if (subencoding & rfbHextileForegroundSpecified) {
+				fg = conv.PixelAt(ptr);
+				ptr += 4;
+			}
+			int n = 0;
+			if (subencoding & rfbHextileAnySubrects)
+				n = *ptr++;
+			fb.FillRect(tx, ty, w, h, bg);
+			for (int i = 0; i < n; i++) {
+				if (subencoding & rfbHextileSubrectsColoured) {
+					fg = conv.PixelAt(ptr);
+					ptr += 4;
+				}
+				fb.FillRect(tx + rfbHextileExtractX(ptr[0]), ty + rfbHextileExtractY(ptr[0]),
+					rfbHextileExtractW(ptr[1]), rfbHextileExtractH(ptr[1]), fg);
+				ptr += 2;
+			}
+		}
+	}
+}
+
+// Tight, with the pixels cut to 3 bytes as they are for this format.
+// Each band of rows is a fill, a palette of up to 256 colours, JPEG if
+// allowed, or the copy filter.  Each kind has its own zlib stream.
+static z_stream tightStreams[4];
+
+static void PutCompactLen(Bytes &out, int len)
+{
+	out.push_back((len & 0x7f) | (len > 0x7f ? 0x80 : 0));
+	if (len > 0x7f) {
+		out.push_back(((len >> 7) & 0x7f) | (len > 0x3fff ? 0x80 : 0));
+		if (len > 0x3fff)
+			out.push_back(len >> 14);
+	}
+}
+
+static void PutRGB(Bytes &out, CARD32 p)
+{
+	out.push_back((p >> 16) & 0xff);
+	out.push_back((p >> 8) & 0xff);
+	out.push_back(p & 0xff);
+}
+
+static void PutCompressed(Bytes &out, int stream, const Bytes &data)
+{
+	if (data.size() < rfbTightMinToCompress) {
+		out.insert(out.end(), data.begin(), data.end());
+		return;
+	}
+	z_stream *zs = &tightStreams[stream];
+	Bytes buf(deflateBound(zs, data.size()) + 64);
+	zs->next_in = (Bytef *) &data[0];
+	zs->avail_in = data.size();
+	zs->next_out = &buf[0];
+	zs->avail_out = buf.size();
+	deflate(zs, Z_SYNC_FLUSH);
+	int len = buf.size() - zs->avail_out;
+	PutCompactLen(out, len);
+	out.insert(out.end(), buf.begin(), buf.begin() + len);
+}
+
+static void PutJpeg(Bytes &out, int y, int h)
+{
+	jpeg_compress_struct cinfo;
+	jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	unsigned char *mem = NULL;
+	unsigned long len = 0;
+	jpeg_mem_dest(&cinfo, &mem, &len);
+	cinfo.image_width = WIDTH;
+	cinfo.image_height = h;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, JPEGQUALITY, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	Bytes row;
+	for (int j = 0; j < h; j++) {
+		row.clear();
+		for (int x = 0; x < WIDTH; x++)
+			PutRGB(row, At(x, y + j));
+		JSAMPROW rows[1] = { &row[0] };
+		jpeg_write_scanlines(&cinfo, rows, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	out.push_back(rfbTightJpeg << 4);
+	PutCompactLen(out, len);
+	out.insert(out.end(), mem, mem + len);
+	free(mem);
+}
+
+static void EncodeTight(Bytes &out, bool jpeg)
+{
+	for (int i = 0; i < 4; i++) {
+		memset(&tightStreams[i], 0, sizeof(z_stream));
+		deflateInit(&tightStreams[i], 6);
+	}
+
+	for (int y = 0; y < HEIGHT; y += TIGHTBAND) {
+		int h = HEIGHT - y < TIGHTBAND ? HEIGHT - y : TIGHTBAND;
+		CARD32 palette[256];
+		int n = 0;
+		for (int i = 0; i < WIDTH * h && n <= 256; i++) {
+			CARD32 p = screen[y * WIDTH + i];
+			int k;
+			for (k = 0; k < n && palette[k] != p; k++) ;
+			if (k == n && n++ < 256) palette[k] = p;
+		}
+
+		Bytes data;
+		if (n == 1) {
+			out.push_back(rfbTightFill << 4);
+			PutRGB(out, palette[0]);
+		} else if (n <= 256) {
+			out.push_back((rfbTightExplicitFilter | 1) << 4);
+			out.push_back(rfbTightFilterPalette);
+			out.push_back(n - 1);
+			for (int k = 0; k < n; k++)
+				PutRGB(out, palette[k]);
+			for (int j = 0; j < h; j++) {
+				CARD8 acc = 0;
+				for (int x = 0; x < WIDTH; x++) {
+					int k;
+					for (k = 0; palette[k] != At(x, y + j); k++) ;
+					if (n > 2) {
+						data.push_back(k);
+						continue;
+					}
+					acc |= k << (7 - (x & 7));
+					if ((x & 7) == 7 || x == WIDTH - 1) {
+						data.push_back(acc);
+						acc = 0;
+					}
+				}
+			}
+			PutCompressed(out, 1, data);
+		} else if (jpeg) {
+			PutJpeg(out, y, h);
+		} else {
+			out.push_back(0);
+			for (int i = 0; i < WIDTH * h; i++)
+				PutRGB(data, screen[y * WIDTH + i]);
+			PutCompressed(out, 0, data);
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+		deflateEnd(&tightStreams[i]);
+}
+
+static int GetCompactLen(const CARD8 *&ptr)
+{
+	int len = *ptr & 0x7f;
+	if (*ptr++ & 0x80) {
+		len |= (*ptr & 0x7f) << 7;
+		if (*ptr++ & 0x80)
+			len |= *ptr++ << 14;
+	}
+	return len;
+}
+
+static bool DecodeJpeg(const CARD8 *data, int len, int y, int h)
+{
+	jpeg_decompress_struct cinfo;
+	jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, (unsigned char *) data, len);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+	bool ok = (int) cinfo.output_width == WIDTH && (int) cinfo.output_height == h;
+	JSAMPARRAY row = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, WIDTH * 3, 1);
+	while (ok && cinfo.output_scanline < cinfo.output_height) {
+		CARD32 *dst = fb.Row(y + cinfo.output_scanline);
+		jpeg_read_scanlines(&cinfo, row, 1);
+		JSAMPLE *p = row[0];
+		for (int i = 0; i < WIDTH; i++, p += 3)
+			dst[i] = PIXEL_RGB(p[0], p[1], p[2]);
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return ok;
+}
+
+static bool DecodeTight(const Bytes &in)
+{
+	ZlibInStream streams[4];
+	const CARD8 *ptr = &in[0];
+	CARD32 palette[256];
+
+	for (int y = 0; y < HEIGHT; y += TIGHTBAND) {
+		int h = HEIGHT - y < TIGHTBAND ? HEIGHT - y : TIGHTBAND;
+		int comp_ctl = *ptr++ >> 4;
+
+		if (comp_ctl == rfbTightFill) {
+			fb.FillRect(0, y, WIDTH, h, PIXEL_RGB(ptr[0], ptr[1], ptr[2]));
+			ptr += 3;
+			continue;
+		}
+		if (comp_ctl == rfbTightJpeg) {
+			int len = GetCompactLen(ptr);
+			if (!DecodeJpeg(ptr, len, y, h)) return false;
+			ptr += len;
+			continue;
+		}
+
+		int filter = rfbTightFilterCopy, numColors = 0;
+		int rowbytes = WIDTH * 3;
+		if (comp_ctl & rfbTightExplicitFilter) {
+			filter = *ptr++;
+			if (filter == rfbTightFilterPalette) {
+				numColors = *ptr++ + 1;
+				for (int i = 0; i < numColors; i++, ptr += 3)
+					palette[i] = PIXEL_RGB(ptr[0], ptr[1], ptr[2]);
+				rowbytes = numColors == 2 ? (WIDTH + 7) / 8 : WIDTH;
+			}
+		}
+
+		ByteSource *src;
+		int size = rowbytes * h;
+		MemoryByteSource mem(ptr, size);
+		ZlibInStream *zs = &streams[comp_ctl & 0x03];
+		if (size < rfbTightMinToCompress) {
+			src = &mem;
+			ptr += size;
+		} else {
+			int len = GetCompactLen(ptr);
+			zs->SetInput(ptr, len);
+			ptr += len;
+			src = zs;
+		}
+
+		for (int j = 0; j < h; j++) {
+			const CARD8 *p = src->Get(rowbytes);
+			if (p == NULL) return false;
+			CARD32 *dst = fb.Row(y + j);
+			if (filter == rfbTightFilterCopy) {
+				for (int i = 0; i < WIDTH; i++, p += 3)
+					dst[i] = PIXEL_RGB(p[0], p[1], p[2]);
+			} else if (numColors == 2) {
+				for (int i = 0; i < WIDTH; i++)
+					dst[i] = palette[(p[i >> 3] >> (7 - (i & 7))) & 1];
+			} else {
+				for (int i = 0; i < WIDTH; i++)
+					dst[i] = palette[p[i]];
+			}
+		}
+		if (src == zs && !zs->FinishInput()) return false;
+	}
+	return true;
+}
+
+// How far the decoded screen is from the original, as the mean absolute
+// difference per colour component
+static double Error()
+{
+	double total = 0;
+	for (int i = 0; i < WIDTH * HEIGHT; i++)
+		for (int shift = 0; shift < 24; shift += 8)
+			total += abs((int) ((bits[i] >> shift) & 0xff) - (int) ((screen[i] >> shift) & 0xff));
+	return total / (WIDTH * HEIGHT * 3);
+}
+
+static void Report(const char *name, const Bytes &data, double secs)
+{
+	printf("  %-12s %8d bytes, %6.2f ms to decode, error %.2f\n",
+		name, (int) data.size(), secs * 1000 / REPEATS, Error());
+}
+
+static void Bench(const char *screenName)
+{
+	printf("%s screen, %dx%d (%d bytes raw):\n", screenName, WIDTH, HEIGHT, WIDTH * HEIGHT * 4);
+
+	Bytes hextile;
+	EncodeHextile(hextile);
+	double start = Now();
+	for (int r = 0; r < REPEATS; r++)
+		DecodeHextile(hextile);
+	Report("Hextile", hextile, Now() - start);
+
+	for (int jpeg = 0; jpeg < 2; jpeg++) {
+		Bytes tight;
+		EncodeTight(tight, jpeg != 0);
+		memset(bits, 0, sizeof(bits));
+		bool ok = true;
+		start = Now();
+		for (int r = 0; r < REPEATS && ok; r++)
+			ok = DecodeTight(tight);
+		if (!ok) printf("  Tight data was bad\n");
+		Report(jpeg ? "Tight JPEG" : "Tight", tight, Now() - start);
+	}
+}
+
+int main()
+{
+	fb.Attach(bits, WIDTH, HEIGHT, WIDTH * sizeof(CARD32));
+	conv.SetFormat(format32);
+	MakeDesktop();
+	Bench("Desktop");
+	MakePhoto();
+	Bench("Photo");
+	return 0;
+}
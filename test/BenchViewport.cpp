@@ -0,0 +1,271 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// BenchViewport.cpp
+// Measures how much less a small window on a large desktop receives
+// when it asks only for the part it shows, with the whole desktop every
+// few seconds, than with /fullupdates.  A stand-in server on the 
+// loopback interface, like BenchPipeline's, keeps track of which 16x16
+// tiles of its desktop have changed, and answers each request with the
+// changed tiles in the requested area as raw rectangles, holding an 
+// incremental request until something in it changes.  The desktop 
+// changes on a simulated clock, so a minute of activity takes a moment.
+// The client asks for updates the way SendIncrementalFramebufferUpdate-
+// Request does.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "rfb.h"
+
+#define WIDTH 1600
+#define HEIGHT 1200
+#define VIEWWIDTH 240
+#define VIEWHEIGHT 320
+#define TILE 16
+#define TILESX (WIDTH / TILE)
+#define TILESY (HEIGHT / TILE)
+// The desktop changes every TICK ms, for RUNTIME ms
+#define TICK 100
+#define RUNTIME 60000
+#define BACKGROUNDINTERVAL 5000
+
+// The simulated time, which only the server moves on
+static volatile unsigned long now;
+static bool changed[TILESY][TILESX];
+
+static void Fail(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void SendAll(int s, const void *buf, int len)
+{
+	for (int sent = 0; sent < len; ) {
+		int n = send(s, (const char *) buf + sent, len - sent, 0);
+		if (n <= 0) Fail("send");
+		sent += n;
+	}
+}
+
+// Returns false at the end of the stream
+static bool RecvAll(int s, void *buf, int len)
+{
+	for (int got = 0; got < len; ) {
+		int n = recv(s, (char *) buf + got, len - got, 0);
+		if (n == 0) return false;
+		if (n < 0) Fail("recv");
+		got += n;
+	}
+	return true;
+}
+
+static void Change(int x, int y, int w, int h)
+{
+	for (int ty = y / TILE; ty < (y + h + TILE - 1) / TILE && ty < TILESY; ty++)
+		for (int tx = x / TILE; tx < (x + w + TILE - 1) / TILE && tx < TILESX; tx++)
+			changed[ty][tx] = true;
+}
+
+// What changes at each tick: a video playing in the middle of the 
+// desktop, a clock in a corner, somebody typing in the part in the 
+// window, and now and then a window being redrawn somewhere.
+static void Tick()
+{
+	now += TICK;
+	Change(1000, 600, 320, 240);
+	if (now % 1000 == 0)
+		Change(1500, 0, 80, 16);
+	if (now % 200 == 0)
+		Change(20 + (now / 200 % 10) * 16, 100, 16, 16);
+	if (now % 2000 == 0)
+		Change(rand() % (WIDTH - 400), rand() % (HEIGHT - 300), 400, 300);
+}
+
+static bool AnyChanged(int x, int y, int w, int h)
+{
+	for (int ty = y / TILE; ty < (y + h + TILE - 1) / TILE; ty++)
+		for (int tx = x / TILE; tx < (x + w + TILE - 1) / TILE; tx++)
+			if (changed[ty][tx]) return true;
+	return false;
+}
+
+static void Put(std::vector<CARD8> &out, const void *data, int len)
+{
+	out.insert(out.end(), (const CARD8 *) data, (const CARD8 *) data + len);
+}
+
+// Sends the tiles of the area which are to go, as raw rectangles, in 
+// one go
+static void SendTiles(int s, int x, int y, int w, int h, bool all)
+{
+	static CARD8 pixels[TILE * TILE * 4];
+	int n = 0;
+	for (int ty = y / TILE; ty < (y + h + TILE - 1) / TILE; ty++)
+		for (int tx = x / TILE; tx < (x + w + TILE - 1) / TILE; tx++)
+			if (all || changed[ty][tx]) n++;
+
+	std::vector<CARD8> update;
+	rfbFramebufferUpdateMsg fu;
+	memset(&fu, 0, sizeof(fu));
+	fu.type = rfbFramebufferUpdate;
+	fu.nRects = Swap16IfLE(n);
+	Put(update, &fu, sz_rfbFramebufferUpdateMsg);
+	for (int ty = y / TILE; ty < (y + h + TILE - 1) / TILE; ty++) {
+		for (int tx = x / TILE; tx < (x + w + TILE - 1) / TILE; tx++) {
+			if (!all && !changed[ty][tx]) continue;
+			changed[ty][tx] = false;
+			rfbFramebufferUpdateRectHeader rh;
+			rh.r.x = Swap16IfLE(tx * TILE);
+			rh.r.y = Swap16IfLE(ty * TILE);
+			rh.r.w = Swap16IfLE(TILE);
+			rh.r.h = Swap16IfLE(TILE);
+			rh.encoding = Swap32IfLE(rfbEncodingRaw);
+			Put(update, &rh, sz_rfbFramebufferUpdateRectHeader);
+			Put(update, pixels, sizeof(pixels));
+		}
+	}
+	SendAll(s, &update[0], update.size());
+}
+
+static void *Server(void *arg)
+{
+	int listener = *(int *) arg;
+	int s = accept(listener, NULL, NULL);
+	if (s < 0) Fail("accept");
+	close(listener);
+
+	for (;;) {
+		rfbFramebufferUpdateRequestMsg fur;
+		if (!RecvAll(s, &fur, sz_rfbFramebufferUpdateRequestMsg)) break;
+		int x = Swap16IfLE(fur.x), y = Swap16IfLE(fur.y);
+		int w = Swap16IfLE(fur.w), h = Swap16IfLE(fur.h);
+		// A tick goes by while the client deals with the last update,
+		// and more until something it wants has changed.  The client
+		// reads the time once the update has arrived.
+		do {
+			Tick();
+		} while (fur.incremental && now < RUNTIME && !AnyChanged(x, y, w, h));
+		if (now >= RUNTIME) break;
+		SendTiles(s, x, y, w, h, !fur.incremental);
+	}
+	close(s);
+	return NULL;
+}
+
+// Start a server thread and connect to it
+static int Connect(pthread_t *thread)
+{
+	static int listener;
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(listener, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+		listen(listener, 1) < 0 ||
+		getsockname(listener, (sockaddr *) &addr, &len) < 0)
+		Fail("listen");
+	pthread_create(thread, NULL, Server, &listener);
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(s, (sockaddr *) &addr, sizeof(addr)) < 0) Fail("connect");
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return s;
+}
+
+static void SendRequest(int s, int x, int y, int w, int h, bool incremental)
+{
+	rfbFramebufferUpdateRequestMsg fur;
+	fur.type = rfbFramebufferUpdateRequest;
+	fur.incremental = incremental ? 1 : 0;
+	fur.x = Swap16IfLE(x);
+	fur.y = Swap16IfLE(y);
+	fur.w = Swap16IfLE(w);
+	fur.h = Swap16IfLE(h);
+	SendAll(s, &fur, sz_rfbFramebufferUpdateRequestMsg);
+}
+
+static void Bench(bool fullUpdates)
+{
+	now = 0;
+	for (int ty = 0; ty < TILESY; ty++)
+		for (int tx = 0; tx < TILESX; tx++)
+			changed[ty][tx] = false;
+	srand(1);
+
+	pthread_t thread;
+	int s = Connect(&thread);
+	unsigned long bytes = 0, updates = 0, viewportRequests = 0, backgroundRequests = 0;
+	unsigned long lastBackgroundRequest = 0;
+
+	SendRequest(s, 0, 0, WIDTH, HEIGHT, false);
+	for (;;) {
+		rfbFramebufferUpdateMsg fu;
+		if (!RecvAll(s, &fu, sz_rfbFramebufferUpdateMsg)) break;
+		bytes += sz_rfbFramebufferUpdateMsg;
+		updates++;
+		static CARD8 rect[sz_rfbFramebufferUpdateRectHeader + TILE * TILE * 4];
+		for (int i = Swap16IfLE(fu.nRects); i > 0; i--) {
+			if (!RecvAll(s, rect, sizeof(rect))) Fail("recv");
+			bytes += sizeof(rect);
+		}
+
+		// As SendIncrementalFramebufferUpdateRequest
+		if (fullUpdates || now - lastBackgroundRequest >= BACKGROUNDINTERVAL) {
+			lastBackgroundRequest = now;
+			backgroundRequests++;
+			SendRequest(s, 0, 0, WIDTH, HEIGHT, true);
+		} else {
+			viewportRequests++;
+			SendRequest(s, 0, 0, VIEWWIDTH, VIEWHEIGHT, true);
+		}
+	}
+	pthread_join(thread, NULL);
+	close(s);
+
+	double secs = RUNTIME / 1000.0;
+	printf("  %-14s %8.0f bytes/s, %5lu updates, %5lu viewport and %5lu whole-desktop requests\n",
+		fullUpdates ? "/fullupdates" : "Viewport only", bytes / secs, updates,
+		viewportRequests, backgroundRequests);
+}
+
+int main()
+{
+	printf("%dx%d desktop in a %dx%d window, %d s of activity, raw 32-bit tiles:\n",
+		WIDTH, HEIGHT, VIEWWIDTH, VIEWHEIGHT, RUNTIME / 1000);
+	Bench(true);
+	Bench(false);
+	return 0;
+}
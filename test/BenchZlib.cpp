@@ -0,0 +1,146 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// BenchZlib.cpp
+// Measures how fast Zlib rectangles are decoded: inflated through a
+// ZlibInStream a band of rows at a time and converted into the 
+// framebuffer, as ReadZlibRect does.  A server's stream of full-screen
+// updates is made here, of a screen with flat areas, text-like detail
+// and some noise, so that it compresses about as well as a desktop.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "zlib.h"
+#include "PixelBuffer.h"
+#include "PixelConverter.h"
+#include "ZlibInStream.h"
+#include "OldPixel.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define UPDATES 50
+
+static CARD32 bits[WIDTH * HEIGHT];
+
+static double Now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A screen's worth of pixels in the given format, different for each 
+// update
+static void MakeScreen(const rfbPixelFormat &pf, int update, std::vector<CARD8> &out)
+{
+	int bpp = pf.bitsPerPixel / 8;
+	out.resize(WIDTH * HEIGHT * bpp);
+	CARD8 *p = &out[0];
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++, p += bpp) {
+			CARD32 r, g, b;
+			if ((x / 160 + y / 120 + update) % 3 == 0) {
+				r = g = b = (rand() % 4 == 0) ? 0 : 255;
+			} else if (y % 40 < 20) {
+				r = 58; g = 110; b = 165;
+			} else {
+				r = (x + update) & 0xff; g = y & 0xff; b = rand() & 0x3f;
+			}
+			CARD32 v = ((r * pf.redMax / 255) << pf.redShift) |
+				((g * pf.greenMax / 255) << pf.greenShift) |
+				((b * pf.blueMax / 255) << pf.blueShift);
+			for (int i = 0; i < bpp; i++)
+				p[i] = (v >> (i * 8)) & 0xff;
+		}
+	}
+}
+
+static void Bench(const char *name, const rfbPixelFormat &pf)
+{
+	int bpp = pf.bitsPerPixel / 8;
+
+	// What the server sends: one zlib stream, each update ending with
+	// a sync flush
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	deflateInit(&zs, Z_DEFAULT_COMPRESSION);
+	std::vector<std::vector<CARD8> > updates(UPDATES);
+	std::vector<CARD8> screen;
+	srand(1);
+	for (int u = 0; u < UPDATES; u++) {
+		MakeScreen(pf, u, screen);
+		updates[u].resize(deflateBound(&zs, screen.size()) + 64);
+		zs.next_in = &screen[0];
+		zs.avail_in = screen.size();
+		zs.next_out = &updates[u][0];
+		zs.avail_out = updates[u].size();
+		deflate(&zs, Z_SYNC_FLUSH);
+		updates[u].resize(updates[u].size() - zs.avail_out);
+	}
+	deflateEnd(&zs);
+
+	PixelConverter conv;
+	conv.SetFormat(pf);
+	PixelBuffer fb;
+	fb.Attach(bits, WIDTH, HEIGHT, WIDTH * sizeof(CARD32));
+	ZlibInStream zis;
+
+	double start = Now();
+	for (int u = 0; u < UPDATES; u++) {
+		zis.SetInput(&updates[u][0], updates[u].size());
+		int rows = ZLIBOUTBUFSIZE / (WIDTH * bpp);
+		for (int y = 0; y < HEIGHT; y += rows) {
+			int n = HEIGHT - y < rows ? HEIGHT - y : rows;
+			const CARD8 *src = zis.Get(n * WIDTH * bpp);
+			if (src == NULL) {
+				printf("Zlib data ended early\n");
+				return;
+			}
+			for (int j = 0; j < n; j++, src += WIDTH * bpp)
+				conv.ConvertRow(src, fb.Row(y + j), WIDTH);
+		}
+		if (!zis.FinishInput()) {
+			printf("Invalid Zlib data\n");
+			return;
+		}
+	}
+	double secs = Now() - start;
+
+	printf("%-8s %6.2f:1, %6.1f MB/s in, %7.1f MB/s out, %5.2f ms per screen\n",
+		name, (double) zis.m_bytesOut / zis.m_bytesIn, zis.m_bytesIn / 1e6 / secs,
+		zis.m_bytesOut / 1e6 / secs, secs * 1000 / UPDATES);
+}
+
+int main()
+{
+	printf("%d updates of %dx%d Zlib\n", UPDATES, WIDTH, HEIGHT);
+	Bench("8-bit", format8);
+	Bench("16-bit", format16);
+	Bench("32-bit", format32);
+	return 0;
+}
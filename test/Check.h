@@ -0,0 +1,60 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// Check.h
+// A minimal way of checking things in the test programs.  Each test 
+// program counts its failures and exits non-zero if there were any.
+
+#pragma once
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(a, b) \
+	do { \
+		unsigned long va = (unsigned long) (a), vb = (unsigned long) (b); \
+		if (va != vb) { \
+			printf("%s:%d: %s is 0x%lx, expected 0x%lx\n", \
+				__FILE__, __LINE__, #a, va, vb); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+inline int CheckResult(const char *name)
+{
+	if (checkFailures == 0)
+		printf("%s: passed\n", name);
+	else
+		printf("%s: %d failures\n", name, checkFailures);
+	return checkFailures != 0;
+}
@@ -0,0 +1,63 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// OldPixel.h
+// How pixels were converted before PixelConverter: three shifts, masks,
+// multiplies and divides for each one, as the COLOR_FROM_PIXEL macros
+// did.  Used as the reference by the tests and benchmarks.
+
+#pragma once
+
+#include "rfb.h"
+
+inline CARD32 OldPixel(const rfbPixelFormat &pf, CARD32 p)
+{
+	CARD32 r = ((p >> pf.redShift) & pf.redMax) * 255 / pf.redMax;
+	CARD32 g = ((p >> pf.greenShift) & pf.greenMax) * 255 / pf.greenMax;
+	CARD32 b = ((p >> pf.blueShift) & pf.blueMax) * 255 / pf.blueMax;
+	return (r << 16) | (g << 8) | b;
+}
+
+inline CARD32 OldPixelAt(const rfbPixelFormat &pf, const CARD8 *p)
+{
+	switch (pf.bitsPerPixel) {
+	case 8:
+		return OldPixel(pf, p[0]);
+	case 16:
+		return OldPixel(pf, p[0] | (p[1] << 8));
+	default:
+		return OldPixel(pf, p[0] | (p[1] << 8) | (p[2] << 16) | ((CARD32) p[3] << 24));
+	}
+}
+
+// The formats the viewer asks for most: vnc8bitFormat, vnc16bitFormat,
+// and the usual 32-bit one
+static const rfbPixelFormat format8 = {8, 8, 0, 1, 7, 7, 3, 0, 3, 6, 0, 0};
+static const rfbPixelFormat format16 = {16, 16, 0, 1, 63, 31, 31, 0, 6, 11, 0, 0};
+static const rfbPixelFormat format32 = {32, 24, 0, 1, 255, 255, 255, 16, 8, 0, 0, 0};
+
+// The other layouts PixelConverter has its own row converters for
+static const rfbPixelFormat format32BGR = {32, 24, 0, 1, 255, 255, 255, 0, 8, 16, 0, 0};
+static const rfbPixelFormat format565 = {16, 16, 0, 1, 31, 63, 31, 11, 5, 0, 0, 0};
+static const rfbPixelFormat format555 = {16, 15, 0, 1, 31, 31, 31, 10, 5, 0, 0, 0};
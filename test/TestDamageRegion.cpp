@@ -0,0 +1,199 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// TestDamageRegion.cpp
+// Checks that the rectangles a region holds stay disjoint, cover 
+// everything added and no more than the bounding box of it, and that 
+// tiles and overlapping rectangles are merged.
+
+#include <stdlib.h>
+#include <string.h>
+#include "DamageRegion.h"
+#include "Check.h"
+
+#define SIZE 256
+
+static DamageRegion region;
+
+static bool Equal(const DamageRect &r, int left, int top, int right, int bottom)
+{
+	return r.left == left && r.top == top && r.right == right && r.bottom == bottom;
+}
+
+static void TestEmpty()
+{
+	region.Clear();
+	region.Add(5, 5, 0, 10);
+	region.Add(5, 5, 10, -1);
+	CHECK(region.IsEmpty());
+	CHECK_EQUAL(region.m_added, 0);
+}
+
+static void TestOverlapping()
+{
+	region.Clear();
+	region.Add(0, 0, 10, 10);
+	region.Add(5, 5, 10, 10);
+	CHECK_EQUAL(region.Count(), 1);
+	CHECK(Equal(region.Rect(0), 0, 0, 15, 15));
+	CHECK_EQUAL(region.m_added, 2);
+
+	// One inside another
+	region.Clear();
+	region.Add(0, 0, 100, 100);
+	region.Add(10, 10, 5, 5);
+	CHECK_EQUAL(region.Count(), 1);
+	CHECK(Equal(region.Rect(0), 0, 0, 100, 100));
+}
+
+static void TestTiles()
+{
+	// A screenful of 16x16 tiles, in the order Hextile sends them
+	region.Clear();
+	for (int y = 0; y < 480; y += 16)
+		for (int x = 0; x < 640; x += 16)
+			region.Add(x, y, 16, 16);
+	CHECK_EQUAL(region.Count(), 1);
+	CHECK(Equal(region.Rect(0), 0, 0, 640, 480));
+	CHECK_EQUAL(region.m_added, 40 * 30);
+
+	// A column of them
+	region.Clear();
+	for (int y = 0; y < 480; y += 16)
+		region.Add(64, y, 16, 16);
+	CHECK_EQUAL(region.Count(), 1);
+	CHECK(Equal(region.Rect(0), 64, 0, 80, 480));
+}
+
+static void TestApart()
+{
+	// Small rectangles far apart aren't merged
+	region.Clear();
+	region.Add(0, 0, 10, 10);
+	region.Add(500, 500, 10, 10);
+	CHECK_EQUAL(region.Count(), 2);
+
+	// Unless there are too many of them
+	region.Clear();
+	for (int i = 0; i < 40; i++)
+		region.Add(i * 20, (i % 3) * 50, 2, 2);
+	CHECK(region.Count() <= MAXDAMAGERECTS);
+	CHECK_EQUAL(region.m_added, 40);
+}
+
+static void TestAddRegion()
+{
+	DamageRegion other;
+	region.Clear();
+	region.Add(0, 0, 10, 10);
+	other.Add(5, 0, 10, 10);
+	other.Add(300, 300, 1, 1);
+	region.Add(other);
+	CHECK_EQUAL(region.Count(), 2);
+	CHECK_EQUAL(region.m_added, 3);
+	int i = Equal(region.Rect(0), 0, 0, 15, 10) ? 0 : 1;
+	CHECK(Equal(region.Rect(i), 0, 0, 15, 10));
+	CHECK(Equal(region.Rect(1 - i), 300, 300, 301, 301));
+}
+
+// Random rectangles, checked pixel by pixel against what was added
+static unsigned char added[SIZE][SIZE], covered[SIZE][SIZE];
+
+static void TestRandom()
+{
+	srand(1);
+	for (int round = 0; round < 200; round++) {
+		region.Clear();
+		memset(added, 0, sizeof(added));
+		memset(covered, 0, sizeof(covered));
+		int left = SIZE, top = SIZE, right = 0, bottom = 0;
+
+		int n = 1 + rand() % 60;
+		for (int k = 0; k < n; k++) {
+			int big = rand() % 4 == 0;
+			int w = 1 + rand() % (big ? 64 : 16);
+			int h = 1 + rand() % (big ? 64 : 16);
+			int x = rand() % (SIZE - w + 1);
+			int y = rand() % (SIZE - h + 1);
+			region.Add(x, y, w, h);
+			for (int j = y; j < y + h; j++)
+				memset(&added[j][x], 1, w);
+			if (x < left) left = x;
+			if (y < top) top = y;
+			if (x + w > right) right = x + w;
+			if (y + h > bottom) bottom = y + h;
+		}
+
+		CHECK(region.Count() >= 1 && region.Count() <= MAXDAMAGERECTS);
+		CHECK_EQUAL(region.m_added, n);
+		bool disjoint = true, inBounds = true;
+		for (int i = 0; i < region.Count(); i++) {
+			const DamageRect &r = region.Rect(i);
+			if (r.left < left || r.top < top || r.right > right || r.bottom > bottom) {
+				inBounds = false;
+				continue;
+			}
+			for (int y = r.top; y < r.bottom; y++) {
+				for (int x = r.left; x < r.right; x++) {
+					if (covered[y][x]) disjoint = false;
+					covered[y][x] = 1;
+				}
+			}
+		}
+		CHECK(disjoint);
+		CHECK(inBounds);
+
+		bool coversAdded = true;
+		for (int y = 0; y < SIZE; y++)
+			for (int x = 0; x < SIZE; x++)
+				if (added[y][x] && !covered[y][x]) coversAdded = false;
+		CHECK(coversAdded);
+
+		// The union of the rectangles has the same bounds as what was added
+		int uleft = SIZE, utop = SIZE, uright = 0, ubottom = 0;
+		for (int i = 0; i < region.Count(); i++) {
+			const DamageRect &r = region.Rect(i);
+			if (r.left < uleft) uleft = r.left;
+			if (r.top < utop) utop = r.top;
+			if (r.right > uright) uright = r.right;
+			if (r.bottom > ubottom) ubottom = r.bottom;
+		}
+		CHECK_EQUAL(uleft, left);
+		CHECK_EQUAL(utop, top);
+		CHECK_EQUAL(uright, right);
+		CHECK_EQUAL(ubottom, bottom);
+	}
+}
+
+int main()
+{
+	TestEmpty();
+	TestOverlapping();
+	TestTiles();
+	TestApart();
+	TestAddRegion();
+	TestRandom();
+	return CheckResult("TestDamageRegion");
+}
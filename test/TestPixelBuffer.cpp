@@ -0,0 +1,116 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// TestPixelBuffer.cpp
+// Checks the framebuffer primitives, including with a stride wider than
+// the buffer, as the bitmap has once the desktop has shrunk.
+
+#include <string.h>
+#include "PixelBuffer.h"
+#include "Check.h"
+
+#define W 20
+#define H 10
+#define STRIDEPIXELS 24
+
+static CARD32 bits[STRIDEPIXELS * H];
+static PixelBuffer fb;
+
+// Fill with a different value in each pixel, including the padding
+static void Reset()
+{
+	for (int i = 0; i < STRIDEPIXELS * H; i++)
+		bits[i] = i;
+}
+
+static CARD32 At(int x, int y)
+{
+	return bits[y * STRIDEPIXELS + x];
+}
+
+static void TestLayout()
+{
+	CHECK_EQUAL(sizeof(CARD32), 4);
+	CHECK(fb.Row(0) == bits);
+	CHECK(fb.Row(3) == bits + 3 * STRIDEPIXELS);
+}
+
+static void TestFillRect()
+{
+	Reset();
+	fb.FillRect(2, 1, 5, 4, 0xabcdef);
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < STRIDEPIXELS; x++) {
+			bool inside = x >= 2 && x < 7 && y >= 1 && y < 5;
+			CHECK_EQUAL(At(x, y), inside ? 0xabcdef : y * STRIDEPIXELS + x);
+		}
+	}
+
+	// Clipped at the right and bottom, leaving the padding alone
+	Reset();
+	fb.FillRect(W - 2, H - 2, 10, 10, 1);
+	CHECK_EQUAL(At(W - 2, H - 2), 1);
+	CHECK_EQUAL(At(W - 1, H - 1), 1);
+	CHECK_EQUAL(At(W, H - 1), (H - 1) * STRIDEPIXELS + W);
+	CHECK_EQUAL(At(W - 3, H - 1), (H - 1) * STRIDEPIXELS + W - 3);
+
+	// Entirely outside
+	Reset();
+	fb.FillRect(W, 0, 5, 5, 1);
+	fb.FillRect(-5, 0, 5, 5, 1);
+	for (int i = 0; i < STRIDEPIXELS * H; i++)
+		CHECK_EQUAL(bits[i], i);
+}
+
+static void TestCopyRect()
+{
+	// Overlapping downwards and upwards
+	Reset();
+	fb.CopyRect(1, 2, 4, 3, 0, 0);
+	for (int y = 0; y < 3; y++)
+		for (int x = 0; x < 4; x++)
+			CHECK_EQUAL(At(1 + x, 2 + y), y * STRIDEPIXELS + x);
+
+	Reset();
+	fb.CopyRect(0, 0, 4, 3, 1, 2);
+	for (int y = 0; y < 3; y++)
+		for (int x = 0; x < 4; x++)
+			CHECK_EQUAL(At(x, y), (2 + y) * STRIDEPIXELS + 1 + x);
+
+	// A source partly outside is trimmed along with the destination
+	Reset();
+	fb.CopyRect(0, 0, 5, 1, W - 3, 0);
+	CHECK_EQUAL(At(0, 0), W - 3);
+	CHECK_EQUAL(At(2, 0), W - 1);
+	CHECK_EQUAL(At(3, 0), 3);
+}
+
+int main()
+{
+	fb.Attach(bits, W, H, STRIDEPIXELS * sizeof(CARD32));
+	TestLayout();
+	TestFillRect();
+	TestCopyRect();
+	return CheckResult("TestPixelBuffer");
+}
@@ -0,0 +1,126 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+// TestPixelConverter.cpp
+// Checks that the table-driven conversion gives the same colours as the
+// arithmetic it replaced.
+
+#include <stdlib.h>
+#include "PixelConverter.h"
+#include "OldPixel.h"
+#include "Check.h"
+
+// Every pixel value for the small formats, and a sample of the big one,
+// converted singly and by the row
+static void TestFormat(const rfbPixelFormat &pf)
+{
+	PixelConverter conv;
+	conv.SetFormat(pf);
+	int bpp = pf.bitsPerPixel / 8;
+	CHECK_EQUAL(conv.m_bytesPerPixel, bpp);
+
+	int n = (bpp == 4) ? 100000 : (1 << pf.bitsPerPixel);
+	CARD8 *src = new CARD8[n * bpp];
+	CARD32 *dst = new CARD32[n];
+	srand(1);
+	for (int i = 0; i < n; i++) {
+		CARD32 p = (bpp == 4) ? ((CARD32) rand() << 16) ^ rand() : i;
+		for (int k = 0; k < bpp; k++)
+			src[i * bpp + k] = (CARD8) (p >> (k * 8));
+	}
+
+	conv.ConvertRow(src, dst, n);
+	int bad = 0;
+	for (int i = 0; i < n; i++) {
+		CARD32 expected = OldPixelAt(pf, src + i * bpp);
+		if (conv.PixelAt(src + i * bpp) != expected || dst[i] != expected)
+			bad++;
+	}
+	CHECK_EQUAL(bad, 0);
+
+	delete [] src;
+	delete [] dst;
+}
+
+// A format change rebuilds the tables
+static void TestChangeFormat()
+{
+	PixelConverter conv;
+	CARD8 white[4] = {0xff, 0xff, 0xff, 0xff};
+	conv.SetFormat(format8);
+	CHECK_EQUAL(conv.PixelAt(white), 0xffffff);
+	conv.SetFormat(format16);
+	CHECK_EQUAL(conv.PixelAt(white), 0xffffff);
+	conv.SetFormat(format32);
+	CHECK_EQUAL(conv.PixelAt(white), 0xffffff);
+	CARD8 red[4] = {0x00, 0x00, 0xff, 0x00};
+	CHECK_EQUAL(conv.PixelAt(red), 0xff0000);
+}
+
+// Each of the fixed-layout row converters against the general one for
+// the same layout, with the source at every alignment and rows of every
+// length up to a few words, so that each of their loops and leftovers 
+// are used.
+static void TestSpecialised(const rfbPixelFormat &pf)
+{
+	PixelConverter fast, general;
+	fast.SetFormat(pf);
+	general.SetFormat(pf, false);
+	int bpp = pf.bitsPerPixel / 8;
+
+	CARD8 src[64 * 4 + 4];
+	srand(2);
+	for (int i = 0; i < (int) sizeof(src); i++)
+		src[i] = (CARD8) rand();
+
+	for (int offset = 0; offset < 4; offset++) {
+		for (int n = 0; n <= 64; n++) {
+			CARD32 a[65], b[65];
+			a[n] = b[n] = 0xdeadbeef;
+			fast.ConvertRow(src + offset, a, n);
+			general.ConvertRow(src + offset, b, n);
+			int bad = 0;
+			for (int i = 0; i < n; i++)
+				if (a[i] != b[i] || a[i] != OldPixelAt(pf, src + offset + i * bpp)) 
+					bad++;
+			CHECK_EQUAL(bad, 0);
+			// Nothing written past the end
+			CHECK_EQUAL(a[n], 0xdeadbeef);
+		}
+	}
+}
+
+int main()
+{
+	TestFormat(format8);
+	TestFormat(format16);
+	TestFormat(format32);
+	TestChangeFormat();
+	TestSpecialised(format16);
+	TestSpecialised(format32);
+	TestSpecialised(format32BGR);
+	TestSpecialised(format565);
+	TestSpecialised(format555);
+	return CheckResult("TestPixelConverter");
+}
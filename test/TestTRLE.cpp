@@ -0,0 +1,310 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// TestTRLE.cpp
+// Decodes TRLE rectangles the way ReadTRLERect does, each 16x16 tile
+// into a tile buffer and then copied into a framebuffer wider than the
+// screen, and checks the result.  Covers each subencoding, including 
+// TRLE's palette reuse, 3-byte CPIXELs, tiles cut short at the edge of
+// a rectangle, and data which must be rejected.
+
+#include <string.h>
+#include <vector>
+#include "RLETileDecoder.h"
+#include "OldPixel.h"
+#include "Check.h"
+
+#define FBWIDTH 40
+#define FBHEIGHT 20
+#define STRIDEPIXELS 48
+#define TILE 16
+
+static CARD32 bits[STRIDEPIXELS * FBHEIGHT];
+static CARD32 tileBits[TILE * TILE];
+static PixelBuffer fb, tile;
+static PixelConverter conv;
+static RLETileDecoder decoder;
+static std::vector<CARD8> data;
+
+// Pixels of format32, which go as 3 bytes
+static const CARD32 red = 0xff0000, green = 0x00ff00, blue = 0x0000ff,
+	white = 0xffffff, grey = 0x808080;
+
+static void PutByte(int b)
+{
+	data.push_back((CARD8) b);
+}
+
+static void PutPixel(CARD32 p)
+{
+	PutByte(p & 0xff);
+	PutByte((p >> 8) & 0xff);
+	PutByte((p >> 16) & 0xff);
+}
+
+static void Start()
+{
+	data.clear();
+	for (int i = 0; i < STRIDEPIXELS * FBHEIGHT; i++)
+		bits[i] = 0x123456;
+	decoder.Attach(&tile, &conv, true);
+}
+
+// As ReadTRLERect
+static bool Decode(int rx, int ry, int rw, int rh)
+{
+	MemoryByteSource src(&data[0], data.size());
+	for (int y = ry; y < ry + rh; y += TILE) {
+		int h = ry + rh - y < TILE ? ry + rh - y : TILE;
+		for (int x = rx; x < rx + rw; x += TILE) {
+			int w = rx + rw - x < TILE ? rx + rw - x : TILE;
+			if (!decoder.DecodeTile(&src, 0, 0, w, h)) return false;
+			for (int j = 0; j < h; j++)
+				memcpy(fb.Row(y + j) + x, tile.Row(j), w * sizeof(CARD32));
+		}
+	}
+	// All the data should have been used
+	return src.Get(1) == NULL;
+}
+
+static CARD32 At(int x, int y)
+{
+	return bits[y * STRIDEPIXELS + x];
+}
+
+static void TestRawAndSolid()
+{
+	// A 20x3 rectangle: a raw 16x3 tile, then a solid 4x3 one
+	Start();
+	PutByte(0);
+	for (int i = 0; i < 16 * 3; i++)
+		PutPixel(i * 0x010203);
+	PutByte(1);
+	PutPixel(grey);
+	CHECK(Decode(2, 1, 20, 3));
+	for (int y = 0; y < 3; y++) {
+		for (int x = 0; x < 16; x++)
+			CHECK_EQUAL(At(2 + x, 1 + y), (y * 16 + x) * 0x010203);
+		for (int x = 16; x < 20; x++)
+			CHECK_EQUAL(At(2 + x, 1 + y), grey);
+	}
+	// Nothing outside the rectangle
+	CHECK_EQUAL(At(1, 1), 0x123456);
+	CHECK_EQUAL(At(22, 1), 0x123456);
+	CHECK_EQUAL(At(2, 4), 0x123456);
+}
+
+static void TestPacked()
+{
+	// Two colours, 1 bit each: rows of 5 pixels 10110, 01001
+	Start();
+	PutByte(2);
+	PutPixel(red);
+	PutPixel(blue);
+	PutByte(0xb0);
+	PutByte(0x48);
+	CHECK(Decode(0, 0, 5, 2));
+	static const CARD32 two[2][5] = {
+		{ blue, red, blue, blue, red }, { red, blue, red, red, blue } };
+	for (int y = 0; y < 2; y++)
+		for (int x = 0; x < 5; x++)
+			CHECK_EQUAL(At(x, y), two[y][x]);
+
+	// Three colours, 2 bits each: 0 1 2 0 1
+	Start();
+	PutByte(3);
+	PutPixel(red);
+	PutPixel(green);
+	PutPixel(blue);
+	PutByte(0x18);
+	PutByte(0x40);
+	CHECK(Decode(0, 0, 5, 1));
+	CHECK_EQUAL(At(0, 0), red);
+	CHECK_EQUAL(At(1, 0), green);
+	CHECK_EQUAL(At(2, 0), blue);
+	CHECK_EQUAL(At(3, 0), red);
+	CHECK_EQUAL(At(4, 0), green);
+
+	// Five colours, 4 bits each: 4 3 2
+	Start();
+	PutByte(5);
+	PutPixel(red);
+	PutPixel(green);
+	PutPixel(blue);
+	PutPixel(white);
+	PutPixel(grey);
+	PutByte(0x43);
+	PutByte(0x20);
+	CHECK(Decode(0, 0, 3, 1));
+	CHECK_EQUAL(At(0, 0), grey);
+	CHECK_EQUAL(At(1, 0), white);
+	CHECK_EQUAL(At(2, 0), blue);
+}
+
+static void TestRuns()
+{
+	// Plain RLE over a 16x2 tile: a run of 20 carrying on to the next 
+	// row, then one of 12
+	Start();
+	PutByte(128);
+	PutPixel(red);
+	PutByte(19);
+	PutPixel(green);
+	PutByte(11);
+	CHECK(Decode(0, 0, 16, 2));
+	for (int i = 0; i < 32; i++)
+		CHECK_EQUAL(At(i % 16, i / 16), i < 20 ? red : green);
+
+	// Palette RLE: a run of 256, whose length takes two bytes, filling
+	// one tile, then single pixels and a run in the next
+	Start();
+	PutByte(130);
+	PutPixel(white);
+	PutPixel(blue);
+	PutByte(0x80);
+	PutByte(255);
+	PutByte(0);
+	PutByte(130);
+	PutPixel(white);
+	PutPixel(blue);
+	PutByte(1);
+	PutByte(0);
+	PutByte(0x81);
+	PutByte(61);
+	CHECK(Decode(0, 0, 20, 16));
+	for (int y = 0; y < 16; y++)
+		for (int x = 0; x < 16; x++)
+			CHECK_EQUAL(At(x, y), white);
+	CHECK_EQUAL(At(16, 0), blue);
+	CHECK_EQUAL(At(17, 0), white);
+	CHECK_EQUAL(At(18, 0), blue);
+	CHECK_EQUAL(At(16, 1), blue);
+	CHECK_EQUAL(At(19, 15), blue);
+}
+
+static void TestReuse()
+{
+	// Palette RLE, then the same palette packed, then run-length encoded
+	Start();
+	PutByte(130);
+	PutPixel(red);
+	PutPixel(blue);
+	PutByte(0x80);
+	PutByte(4);
+	PutByte(1);
+	PutByte(0x81);
+	PutByte(1);
+	PutByte(127);
+	PutByte(0xa0);
+	PutByte(0x50);
+	PutByte(129);
+	PutByte(0x81);
+	PutByte(7);
+
+	MemoryByteSource src(&data[0], data.size());
+	CHECK(decoder.DecodeTile(&src, 0, 0, 4, 2));
+	static const CARD32 first[2][4] = { { red, red, red, red }, { red, blue, blue, blue } };
+	for (int y = 0; y < 2; y++)
+		for (int x = 0; x < 4; x++)
+			CHECK_EQUAL(tile.Row(y)[x], first[y][x]);
+
+	CHECK(decoder.DecodeTile(&src, 0, 0, 4, 2));
+	static const CARD32 packed[2][4] = { { blue, red, blue, red }, { red, blue, red, blue } };
+	for (int y = 0; y < 2; y++)
+		for (int x = 0; x < 4; x++)
+			CHECK_EQUAL(tile.Row(y)[x], packed[y][x]);
+
+	CHECK(decoder.DecodeTile(&src, 0, 0, 4, 2));
+	for (int y = 0; y < 2; y++)
+		for (int x = 0; x < 4; x++)
+			CHECK_EQUAL(tile.Row(y)[x], blue);
+	CHECK(src.Get(1) == NULL);
+}
+
+static void TestBad()
+{
+	// Reuse with no palette yet
+	RLETileDecoder fresh;
+	fresh.Attach(&tile, &conv, true);
+	CARD8 reuse[] = { 127, 0 };
+	MemoryByteSource src1(reuse, sizeof(reuse));
+	CHECK(!fresh.DecodeTile(&src1, 0, 0, 4, 1));
+
+	// Reuse isn't allowed in ZRLE
+	RLETileDecoder zrle;
+	zrle.Attach(&tile, &conv);
+	CARD8 twice[] = { 2, 0, 0, 0, 1, 1, 1, 0x50, 127, 0x50 };
+	MemoryByteSource src2(twice, sizeof(twice));
+	CHECK(zrle.DecodeTile(&src2, 0, 0, 4, 1));
+	CHECK(!zrle.DecodeTile(&src2, 0, 0, 4, 1));
+
+	// Packed and run-length palette indices beyond the palette, and a run
+	// past the tile's end
+	CARD8 packed[] = { 3, 0, 0, 0, 1, 1, 1, 2, 2, 2, 0xC0 };
+	MemoryByteSource src7(packed, sizeof(packed));
+	CHECK(!decoder.DecodeTile(&src7, 0, 0, 1, 1));
+	CARD8 index[] = { 130, 0, 0, 0, 1, 1, 1, 2 };
+	MemoryByteSource src3(index, sizeof(index));
+	CHECK(!decoder.DecodeTile(&src3, 0, 0, 4, 1));
+	CARD8 run[] = { 128, 0, 0, 0, 4 };
+	MemoryByteSource src4(run, sizeof(run));
+	CHECK(!decoder.DecodeTile(&src4, 0, 0, 4, 1));
+
+	// Unused subencodings, and data cut short
+	CARD8 unused[] = { 17 };
+	MemoryByteSource src5(unused, sizeof(unused));
+	CHECK(!decoder.DecodeTile(&src5, 0, 0, 4, 1));
+	CARD8 shortRaw[] = { 0, 1, 2, 3 };
+	MemoryByteSource src6(shortRaw, sizeof(shortRaw));
+	CHECK(!decoder.DecodeTile(&src6, 0, 0, 4, 1));
+}
+
+// In 16-bit, pixels are 2 bytes
+static void Test16()
+{
+	PixelConverter conv16;
+	conv16.SetFormat(format565);
+	decoder.Attach(&tile, &conv16, true);
+	CARD8 solid[] = { 1, 0x1f, 0xf8 };
+	MemoryByteSource src(solid, sizeof(solid));
+	CHECK(decoder.DecodeTile(&src, 0, 0, 3, 3));
+	CHECK_EQUAL(tile.Row(2)[2], OldPixel(format565, 0xf81f));
+	CHECK(src.Get(1) == NULL);
+}
+
+int main()
+{
+	fb.Attach(bits, FBWIDTH, FBHEIGHT, STRIDEPIXELS * sizeof(CARD32));
+	tile.Attach(tileBits, TILE, TILE, TILE * sizeof(CARD32));
+	conv.SetFormat(format32);
+	CHECK_EQUAL(conv.m_cpixelBytes, 3);
+	TestRawAndSolid();
+	TestPacked();
+	TestRuns();
+	TestReuse();
+	TestBad();
+	Test16();
+	return CheckResult("TestTRLE");
+}
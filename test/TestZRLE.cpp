@@ -0,0 +1,281 @@
+//  Copyright (C) 1997, 1998 Olivetti & Oracle Research Laboratory
+//
+//  This file is part of the VNC system.
+//
+//  The VNC system is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+//  USA.
+//
+// If the source code for the VNC system is not available from the place 
+// whence you received this file, check http://www.orl.co.uk/vnc or contact
+// the authors on vnc@orl.co.uk for information on obtaining it.
+
+
+
+// TestZRLE.cpp
+// Decodes ZRLE rectangles through ZlibInStream and RLETileDecoder and
+// compares the framebuffer with what should be there.  The rectangles 
+// are made here, a tile at a time with every subencoding chosen at 
+// random, and compressed with zlib as one stream the way a server does.
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "zlib.h"
+#include "RLETileDecoder.h"
+#include "ZlibInStream.h"
+#include "OldPixel.h"
+#include "Check.h"
+
+#define FBWIDTH 300
+#define FBHEIGHT 200
+#define RECTS 6
+
+// 32-bit pixels in the top three bytes, sent as 3-byte CPIXELs too
+static const rfbPixelFormat format32High = {32, 24, 0, 1, 255, 255, 255, 24, 16, 8, 0, 0};
+
+static const rfbPixelFormat *format;
+static std::vector<CARD8> raw;
+static CARD32 expected[FBWIDTH * FBHEIGHT];
+
+static int Random(int n)
+{
+	return rand() % n;
+}
+
+static CARD32 RandomPixel()
+{
+	return (Random(format->redMax + 1) << format->redShift) |
+		(Random(format->greenMax + 1) << format->greenShift) |
+		(Random(format->blueMax + 1) << format->blueShift);
+}
+
+static void PutByte(int b)
+{
+	raw.push_back((CARD8) b);
+}
+
+// A CPIXEL: 32-bit pixels lose whichever byte is never used
+static void PutPixel(CARD32 p)
+{
+	int bytes = format->bitsPerPixel / 8;
+	if (bytes == 4) {
+		if (format->redShift == 24) p >>= 8;
+		bytes = 3;
+	}
+	for (int i = 0; i < bytes; i++)
+		PutByte((p >> (i * 8)) & 0xff);
+}
+
+static void PutRunLength(int n)
+{
+	for (n--; n >= 255; n -= 255)
+		PutByte(255);
+	PutByte(n);
+}
+
+static void Set(int x, int y, CARD32 p)
+{
+	expected[y * FBWIDTH + x] = OldPixel(*format, p);
+}
+
+static void MakeTile(int tx, int ty, int tw, int th)
+{
+	static const int runs[] = { 1, 2, 5, 64, 300, 600 };
+	CARD32 palette[127];
+	int n = 0;
+
+	switch (Random(5)) {
+	case 0:		// Raw
+		PutByte(0);
+		for (int y = ty; y < ty + th; y++) {
+			for (int x = tx; x < tx + tw; x++) {
+				CARD32 p = RandomPixel();
+				PutPixel(p);
+				Set(x, y, p);
+			}
+		}
+		break;
+	case 1: {	// Solid
+		CARD32 p = RandomPixel();
+		PutByte(1);
+		PutPixel(p);
+		for (int y = ty; y < ty + th; y++)
+			for (int x = tx; x < tx + tw; x++)
+				Set(x, y, p);
+		break;
+		}
+	case 2: {	// Packed palette, each row starting on a byte
+		n = 2 + Random(15);
+		PutByte(n);
+		for (int i = 0; i < n; i++) {
+			palette[i] = RandomPixel();
+			PutPixel(palette[i]);
+		}
+		int bits = n == 2 ? 1 : n <= 4 ? 2 : 4;
+		for (int y = ty; y < ty + th; y++) {
+			int acc = 0, nbits = 0;
+			for (int x = tx; x < tx + tw; x++) {
+				int k = Random(n);
+				Set(x, y, palette[k]);
+				acc = (acc << bits) | k;
+				nbits += bits;
+				if (nbits == 8) {
+					PutByte(acc);
+					acc = nbits = 0;
+				}
+			}
+			if (nbits)
+				PutByte(acc << (8 - nbits));
+		}
+		break;
+		}
+	case 3:		// Plain RLE
+		PutByte(128);
+		for (int pos = 0, total = tw * th; pos < total; ) {
+			int len = runs[Random(6)];
+			if (len > total - pos) len = total - pos;
+			CARD32 p = RandomPixel();
+			PutPixel(p);
+			PutRunLength(len);
+			for (int q = pos; q < pos + len; q++)
+				Set(tx + q % tw, ty + q / tw, p);
+			pos += len;
+		}
+		break;
+	default:	// Palette RLE
+		n = 2 + Random(126);
+		PutByte(128 + n);
+		for (int i = 0; i < n; i++) {
+			palette[i] = RandomPixel();
+			PutPixel(palette[i]);
+		}
+		for (int pos = 0, total = tw * th; pos < total; ) {
+			int len = runs[Random(6)];
+			if (len > total - pos) len = total - pos;
+			int k = Random(n);
+			if (len == 1) {
+				PutByte(k);
+			} else {
+				PutByte(k | 128);
+				PutRunLength(len);
+			}
+			for (int q = pos; q < pos + len; q++)
+				Set(tx + q % tw, ty + q / tw, palette[k]);
+			pos += len;
+		}
+		break;
+	}
+}
+
+// Random rectangles in the given format, decoded one after another from
+// a single zlib stream, as they would be over one connection.
+static void TestFormat(const rfbPixelFormat &pf, int cpixelBytes)
+{
+	format = &pf;
+	PixelConverter conv;
+	conv.SetFormat(pf);
+	CHECK_EQUAL(conv.m_cpixelBytes, cpixelBytes);
+
+	static CARD32 bits[FBWIDTH * FBHEIGHT];
+	memset(bits, 0, sizeof(bits));
+	memset(expected, 0, sizeof(expected));
+	PixelBuffer fb;
+	fb.Attach(bits, FBWIDTH, FBHEIGHT, FBWIDTH * sizeof(CARD32));
+	RLETileDecoder decoder;
+	decoder.Attach(&fb, &conv);
+	ZlibInStream zis;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	deflateInit(&zs, Z_DEFAULT_COMPRESSION);
+	std::vector<CARD8> compressed;
+
+	for (int r = 0; r < RECTS; r++) {
+		int rw = 1 + Random(200), rh = 1 + Random(150);
+		int rx = Random(FBWIDTH - rw + 1), ry = Random(FBHEIGHT - rh + 1);
+		raw.clear();
+		for (int y = ry; y < ry + rh; y += 64)
+			for (int x = rx; x < rx + rw; x += 64)
+				MakeTile(x, y, rx + rw - x < 64 ? rx + rw - x : 64, 
+					ry + rh - y < 64 ? ry + rh - y : 64);
+
+		// Each rectangle ends with a sync flush
+		compressed.resize(deflateBound(&zs, raw.size()) + 64);
+		zs.next_in = &raw[0];
+		zs.avail_in = raw.size();
+		zs.next_out = &compressed[0];
+		zs.avail_out = compressed.size();
+		CHECK_EQUAL(deflate(&zs, Z_SYNC_FLUSH), Z_OK);
+		CHECK_EQUAL(zs.avail_in, 0);
+		int len = compressed.size() - zs.avail_out;
+
+		zis.SetInput(&compressed[0], len);
+		bool ok = true;
+		for (int y = ry; ok && y < ry + rh; y += 64)
+			for (int x = rx; ok && x < rx + rw; x += 64)
+				ok = decoder.DecodeTile(&zis, x, y, rx + rw - x < 64 ? rx + rw - x : 64, 
+					ry + rh - y < 64 ? ry + rh - y : 64);
+		CHECK(ok);
+		CHECK(zis.FinishInput());
+	}
+	deflateEnd(&zs);
+
+	int bad = 0;
+	for (int i = 0; i < FBWIDTH * FBHEIGHT; i++)
+		if (bits[i] != expected[i]) bad++;
+	CHECK_EQUAL(bad, 0);
+}
+
+// A rectangle cut short must fail rather than read past its data
+static void TestTruncated()
+{
+	format = &format32;
+	PixelConverter conv;
+	conv.SetFormat(format32);
+	static CARD32 bits[64 * 64];
+	PixelBuffer fb;
+	fb.Attach(bits, 64, 64, 64 * sizeof(CARD32));
+	RLETileDecoder decoder;
+	decoder.Attach(&fb, &conv);
+
+	raw.clear();
+	PutByte(0);
+	for (int i = 0; i < 64 * 64; i++)
+		PutPixel(RandomPixel());
+	uLongf len = compressBound(raw.size());
+	std::vector<CARD8> compressed(len);
+	compress(&compressed[0], &len, &raw[0], raw.size());
+
+	ZlibInStream zis;
+	zis.SetInput(&compressed[0], len / 2);
+	CHECK(!decoder.DecodeTile(&zis, 0, 0, 64, 64));
+
+	// And a subencoding ZRLE doesn't have
+	MemoryByteSource src((const CARD8 *) "\x7f", 1);
+	CHECK(!decoder.DecodeTile(&src, 0, 0, 64, 64));
+}
+
+int main()
+{
+	srand(1);
+	for (int i = 0; i < 10; i++) {
+		TestFormat(format32, 3);
+		TestFormat(format32High, 3);
+		TestFormat(format565, 2);
+		TestFormat(format8, 1);
+	}
+	TestTruncated();
+	return CheckResult("TestZRLE");
+}
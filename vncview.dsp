@@ -65,7 +65,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 commctrl.lib coredll.lib /nologo /subsystem:windows /machine:I386 /windowsce:emulation
-# ADD LINK32 winsockm.lib commctrl.lib coredll.lib /nologo /subsystem:windows /machine:I386 /windowsce:emulation
+# ADD LINK32 winsockm.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /subsystem:windows /machine:I386 /windowsce:emulation
 EMPFILE=empfile.exe
 # ADD BASE EMPFILE -COPY
 # ADD EMPFILE -COPY
@@ -97,7 +97,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 commctrl.lib coredll.lib /nologo /subsystem:windows /debug /machine:I386 /windowsce:emulation
-# ADD LINK32 winsockm.lib commctrl.lib coredll.lib /nologo /subsystem:windows /debug /machine:I386 /windowsce:emulation
+# ADD LINK32 winsockm.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /subsystem:windows /debug /machine:I386 /windowsce:emulation
 EMPFILE=empfile.exe
 # ADD BASE EMPFILE -COPY
 # ADD EMPFILE -COPY
@@ -130,7 +130,7 @@ BSC32=bscmake.exe
 LINK32=link.exe
 # ADD BASE LINK32 commctrl.lib coredll.lib /nologo /machine:MIPS /subsystem:$(CESubsystem)
 # SUBTRACT BASE LINK32 /pdb:none /nodefaultlib
-# ADD LINK32 winsock.lib commctrl.lib coredll.lib /nologo /machine:MIPS /subsystem:$(CESubsystem)
+# ADD LINK32 winsock.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /machine:MIPS /subsystem:$(CESubsystem)
 # SUBTRACT LINK32 /pdb:none /nodefaultlib
 PFILE=pfile.exe
 # ADD BASE PFILE COPY
@@ -164,7 +164,7 @@ BSC32=bscmake.exe
 LINK32=link.exe
 # ADD BASE LINK32 commctrl.lib coredll.lib /nologo /debug /machine:MIPS /subsystem:$(CESubsystem)
 # SUBTRACT BASE LINK32 /pdb:none /nodefaultlib
-# ADD LINK32 winsock.lib commctrl.lib coredll.lib /nologo /debug /machine:MIPS /subsystem:$(CESubsystem)
+# ADD LINK32 winsock.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /debug /machine:MIPS /subsystem:$(CESubsystem)
 # SUBTRACT LINK32 /pdb:none /nodefaultlib
 PFILE=pfile.exe
 # ADD BASE PFILE COPY
@@ -198,7 +198,7 @@ BSC32=bscmake.exe
 LINK32=link.exe
 # ADD BASE LINK32 commctrl.lib coredll.lib /nologo /debug /machine:SH3 /subsystem:$(CESubsystem)
 # SUBTRACT BASE LINK32 /pdb:none /nodefaultlib
-# ADD LINK32 winsock.lib commctrl.lib coredll.lib /nologo /debug /machine:SH3 /subsystem:$(CESubsystem)
+# ADD LINK32 winsock.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /debug /machine:SH3 /subsystem:$(CESubsystem)
 # SUBTRACT LINK32 /pdb:none /nodefaultlib
 PFILE=pfile.exe
 # ADD BASE PFILE COPY
@@ -231,7 +231,7 @@ BSC32=bscmake.exe
 LINK32=link.exe
 # ADD BASE LINK32 winsockm.lib commctrl.lib coredll.lib /nologo /machine:IX86 /windowsce:emulation
 # SUBTRACT BASE LINK32 /pdb:none /nodefaultlib
-# ADD LINK32 winsock.lib commctrl.lib coredll.lib /nologo /machine:SH3 /subsystem:$(CESubsystem)
+# ADD LINK32 winsock.lib zlib.lib jpeg.lib commctrl.lib coredll.lib /nologo /machine:SH3 /subsystem:$(CESubsystem)
 # SUBTRACT LINK32 /pdb:none
 PFILE=pfile.exe
 # ADD BASE PFILE COPY
@@ -523,6 +523,10 @@ SOURCE=.\AuthDialog.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ByteSource.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\ClientConnection.cpp
 
 !IF  "$(CFG)" == "vncview - Win32 (WCE x86em) Release"
@@ -1325,6 +1329,30 @@ NODEP_CPP_CLIENTCONN=\
 # End Source File
 # Begin Source File
 
+SOURCE=.\ClientConnectionTRLE.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ClientConnectionZlib.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ClientConnectionZlibHex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ClientConnectionZRLE.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ClientConnectionTight.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ClientConnectionStats.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\res\cursor1.cur
 # End Source File
 # Begin Source File
@@ -1376,6 +1404,14 @@ SOURCE=.\d3des.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\DamageRegion.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\DamageRegion.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\Exception.h
 # End Source File
 # Begin Source File
@@ -1523,6 +1559,14 @@ SOURCE=.\keysymdef.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\LocalCursor.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\LocalCursor.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\Log.cpp
 
 !IF  "$(CFG)" == "vncview - Win32 (WCE x86em) Release"
@@ -1635,6 +1679,22 @@ SOURCE=.\MRU.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\PixelBuffer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\PixelBuffer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\PixelConverter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\PixelConverter.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\res\resource.h
 # End Source File
 # Begin Source File
@@ -1647,6 +1707,14 @@ SOURCE=.\rfbproto.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\RLETileDecoder.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\RLETileDecoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SessionDialog.cpp
 
 !IF  "$(CFG)" == "vncview - Win32 (WCE x86em) Release"
@@ -1796,6 +1864,14 @@ SOURCE=.\SessionDialog.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SessionRecorder.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SessionRecorder.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\stdhdrs.cpp
 
 !IF  "$(CFG)" == "vncview - Win32 (WCE x86em) Release"
@@ -2504,5 +2580,13 @@ NODEP_CPP_VNCVIEW=\
 
 SOURCE=.\VNCviewerAppCE.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\ZlibInStream.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\ZlibInStream.h
+# End Source File
 # End Target
 # End Project
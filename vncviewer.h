@@ -30,6 +30,8 @@
 
 #define WM_SOCKEVENT WM_USER+1
 #define WM_TRAYNOTIFY WM_SOCKEVENT+1
+#define WM_REGIONUPDATED WM_TRAYNOTIFY+1
+#define WM_DESKTOPRESIZED WM_TRAYNOTIFY+2
 
 // The Application
 extern VNCviewerApp *pApp;